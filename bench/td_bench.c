@@ -0,0 +1,892 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2025 Võ Quang Chiến
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+// Benchmark harness: generates a synthetic TODO.md, times the hot paths of
+// td on it and prints a JSON report that can be compared between builds
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "../src/project.h"
+#include "../src/services/batch.h"
+#include "../src/services/index.h"
+#include "../src/services/journal.h"
+#include "../src/services/lock.h"
+#include "../src/services/selector.h"
+#include "../src/services/storage.h"
+#include "../src/utils/fmt.h"
+#include "../src/utils/render.h"
+#include "../src/utils/scan.h"
+
+// Constants
+#define MAX_SAMPLES 100000
+#define MAX_STRESS_PROCS 256
+#define STRESS_TAG "stress "
+#define STRESS_VERIFY_EVERY 4 // Reader rounds between locked index checks
+#define CHECK_SPAN (1 << 16) // Largest buffer of the scanner check
+
+// Shape of the generated document
+struct BenchConfig {
+  size_t tasks;
+  size_t line_length; // Average task content length in bytes
+  double done_ratio;
+  size_t preamble;   // Bytes of prose before the first task
+  double utf8_ratio; // Share of words that are not ASCII
+  uint64_t seed;
+  size_t iterations;
+  const char *dir;
+  const char *output;
+  size_t writers; // Stress mode: concurrent writer processes, 0 for off
+  size_t readers; // Stress mode: concurrent reader processes
+  bool journal;   // Mutations go through the journal
+  bool index;     // Stress mode: keep a sidecar index, readers refresh it
+  size_t check_scan; // Scanner check mode: rounds to run, 0 for off
+};
+
+// What one stress process did, lives in memory shared with the parent
+struct StressSlot {
+  uint64_t ops;
+  uint64_t retries; // Batch commits that lost the race and were redone
+  uint64_t errors;
+  uint64_t stale; // Valid looking indexes that disagreed with the file
+};
+
+// Shared state of a stress run
+struct Stress {
+  atomic_bool stop; // Tells readers the writers are done
+  struct StressSlot writers[MAX_STRESS_PROCS];
+  struct StressSlot readers[MAX_STRESS_PROCS];
+};
+
+// Timings of one benchmark
+struct Samples {
+  const char *name;
+  uint64_t *ns;
+  size_t count;
+  size_t bytes; // Bytes processed per iteration
+  size_t items; // Tasks processed per iteration
+};
+
+// xorshift64*, the same seed always yields the same document
+uint64_t next_random(uint64_t *state) {
+  uint64_t x = *state;
+  x ^= x >> 12;
+  x ^= x << 25;
+  x ^= x >> 27;
+  *state = x;
+  return x * 0x2545f4914f6cdd1dull;
+}
+
+double random_unit(uint64_t *state) {
+  return (next_random(state) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static const char *ascii_words[] = {
+    "fix",    "write", "review", "parser", "release", "docs",  "index",
+    "deploy", "cache", "test",   "config", "update",  "build", "refactor",
+};
+
+static const char *utf8_words[] = {
+    "Học",      "lập",    "trình",    "Việt", "tiếng", "日本語",
+    "タスク",   "中文",   "任务",     "한국어", "ção",   "über",
+};
+
+// Write one task line of about line_length content bytes
+void write_task(FILE *out, const struct BenchConfig *cfg, uint64_t *state,
+                size_t n) {
+  fputs(random_unit(state) < cfg->done_ratio ? "- [x] " : "- [ ] ", out);
+
+  int written = fprintf(out, "task %zu", n);
+  while ((size_t)written < cfg->line_length) {
+    const char *word;
+    if (random_unit(state) < cfg->utf8_ratio) {
+      word = utf8_words[next_random(state) % (sizeof(utf8_words) /
+                                              sizeof(*utf8_words))];
+    } else {
+      word = ascii_words[next_random(state) % (sizeof(ascii_words) /
+                                               sizeof(*ascii_words))];
+    }
+    written += fprintf(out, " %s", word);
+  }
+  fputc('\n', out);
+}
+
+// Generate the synthetic document at path
+bool generate(const char *path, const struct BenchConfig *cfg) {
+  FILE *out = fopen(path, "w");
+  if (!out) {
+    fprintf(stderr, "td_bench: %s: %s\n", path, strerror(errno));
+    return false;
+  }
+
+  uint64_t state = cfg->seed ? cfg->seed : 1;
+  fputs("# Benchmark\n\n", out);
+  for (size_t written = 0; written < cfg->preamble;) {
+    written += fprintf(out, "Notes line %zu about the project.\n", written);
+  }
+  fputc('\n', out);
+
+  for (size_t i = 0; i < cfg->tasks; i++) {
+    write_task(out, cfg, &state, i + 1);
+  }
+
+  bool ok = fclose(out) == 0;
+  if (!ok) {
+    fprintf(stderr, "td_bench: %s: %s\n", path, strerror(errno));
+  }
+  return ok;
+}
+
+// Remove a generated file and the sidecars td leaves next to it
+void remove_generated(const char *path) {
+  journal_remove(path);
+  char *lock = sidecar_path(path, "tdlock");
+  if (lock) {
+    unlink(lock);
+    free(lock);
+  }
+  char *idx = index_path(path);
+  if (idx) {
+    unlink(idx);
+    free(idx);
+  }
+  unlink(path);
+}
+
+// Copy src to dst so destructive benchmarks start from the same document
+bool copy_file(const char *src, const char *dst) {
+  struct Document doc;
+  if (!doc_open(&doc, src)) {
+    return false;
+  }
+  journal_remove(dst); // Its records belong to the document being replaced
+  FILE *out = fopen(dst, "w");
+  bool ok = out && fwrite(doc.data, 1, doc.size, out) == doc.size;
+  if (out) {
+    ok = fclose(out) == 0 && ok;
+  }
+  doc_close(&doc);
+  return ok;
+}
+
+bool samples_init(struct Samples *s, const char *name, size_t iterations) {
+  *s = (struct Samples){.name = name};
+  s->ns = malloc(iterations * sizeof(*s->ns));
+  return s->ns != NULL;
+}
+
+int compare_u64(const void *a, const void *b) {
+  uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+  return (x > y) - (x < y);
+}
+
+// Value at quantile q of sorted samples
+uint64_t percentile(const struct Samples *s, double q) {
+  size_t i = (size_t)(q * (s->count - 1) + 0.5);
+  return s->ns[i];
+}
+
+// Benchmarks, each returns false if td reported an error
+
+bool bench_parse(const char *path, struct Samples *s) {
+  uint64_t start = now_ns();
+  struct Document doc;
+  if (!doc_open(&doc, path)) {
+    return false;
+  }
+  struct TodoTable table;
+  bool ok = list_todos(&doc, &table);
+  s->ns[s->count++] = now_ns() - start;
+  s->bytes = doc.size;
+  s->items = table.count;
+  if (ok) {
+    free_table(&table);
+  }
+  doc_close(&doc);
+  return ok;
+}
+
+bool bench_render(const struct Document *doc, const struct TodoTable *table,
+                  int sink, struct Samples *s) {
+  uint64_t start = now_ns();
+  uint32_t max_id = table->count ? table->ids[table->count - 1] : 0;
+  size_t max_width = 0;
+  for (size_t i = 0; i < table->count; i++) {
+    size_t width =
+        display_width(doc->data + table->offsets[i], table->lengths[i]);
+    max_width = width > max_width ? width : max_width;
+  }
+
+  struct Render r;
+  bool ok = render_begin(&r, sink, max_id, max_width);
+  for (size_t i = 0; ok && i < table->count; i++) {
+    render_row(&r, table->ids[i], doc->data + table->offsets[i],
+               table->lengths[i], bitmap_get(table->done, i));
+  }
+  ok = render_end(&r) && ok;
+  s->ns[s->count++] = now_ns() - start;
+  s->bytes = doc->size;
+  s->items = table->count;
+  return ok;
+}
+
+bool bench_write(const struct Document *doc, const struct TodoTable *table,
+                 const char *path, struct Samples *s) {
+  uint64_t start = now_ns();
+  bool ok = write_todos(doc, table, path, DURABILITY_NONE);
+  s->ns[s->count++] = now_ns() - start;
+  s->bytes = doc->size;
+  s->items = table->count;
+  return ok;
+}
+
+bool bench_add(const char *path, struct Samples *s) {
+  uint64_t start = now_ns();
+  bool ok = add_todo(path, "benchmark task appended by td_bench", false);
+  s->ns[s->count++] = now_ns() - start;
+  s->items = 1;
+  return ok;
+}
+
+bool bench_done(const char *path, size_t tasks, uint64_t *state,
+                struct Samples *s) {
+  struct Selector sel;
+  if (!selector_id(&sel, next_random(state) % tasks + 1)) {
+    return false;
+  }
+  uint64_t start = now_ns();
+  bool ok = set_status(path, &sel, s->count % 2 == 0, DURABILITY_NONE);
+  s->ns[s->count++] = now_ns() - start;
+  s->items = 1;
+  selector_free(&sel);
+  return ok;
+}
+
+bool bench_remove(const char *path, size_t tasks, uint64_t *state,
+                  struct Samples *s) {
+  struct Selector sel;
+  if (!selector_id(&sel, next_random(state) % (tasks - s->count) + 1)) {
+    return false;
+  }
+  uint64_t start = now_ns();
+  bool ok = remove_todos(path, &sel, DURABILITY_NONE);
+  s->ns[s->count++] = now_ns() - start;
+  s->items = 1;
+  selector_free(&sel);
+  return ok;
+}
+
+// Stress mode: writers race each other through every write path while
+// readers keep parsing the file, then the file is checked for lost updates
+
+// One writer, op j tags its task "stress <writer>.<j>"
+void stress_writer(const char *path, const struct BenchConfig *cfg,
+                   size_t writer, struct StressSlot *slot) {
+  uint64_t state = (cfg->seed ? cfg->seed : 1) + writer * 7919;
+  char task[64];
+
+  for (size_t j = 0; j < cfg->iterations; j++) {
+    snprintf(task, sizeof(task), STRESS_TAG "%zu.%zu", writer, j);
+
+    // Touch the file so readers find the index out of date and rebuild it
+    // while the next status flip lands in place. Under the lock, a writer
+    // that saw the old time would fail its update rather than race it.
+    struct Lock lock;
+    if (cfg->index && lock_acquire(&lock, path)) {
+      utimensat(AT_FDCWD, path, NULL, 0);
+      lock_release(&lock);
+    }
+
+    // Flip the status of a generated task in place between adds
+    struct Selector sel;
+    if (selector_id(&sel, next_random(&state) % cfg->tasks + 1)) {
+      slot->errors += !set_status(path, &sel, j % 2, DURABILITY_NONE);
+      selector_free(&sel);
+    }
+
+    if (j % 2 == 0) {
+      slot->errors += !add_todo(path, task, false);
+      slot->ops += 2;
+      continue;
+    }
+
+    // Rename path, a conflict is a lost race to retry, not a lost update
+    for (;;) {
+      struct Batch b;
+      if (!batch_open(&b, path)) {
+        slot->errors++;
+        break;
+      }
+      errno = 0;
+      bool ok = batch_add(&b, task, false) && batch_commit(&b, DURABILITY_NONE);
+      int err = errno;
+      batch_close(&b);
+      if (ok || err != EAGAIN) {
+        slot->errors += !ok;
+        break;
+      }
+      slot->retries++;
+    }
+    slot->ops += 2;
+  }
+}
+
+// With writers locked out, check that an index which matches the file on
+// disk also holds what a parse of it finds. False if it does not.
+bool stress_verify_index(const char *path) {
+  struct Lock lock;
+  if (!lock_acquire(&lock, path)) {
+    return true;
+  }
+
+  struct Document doc;
+  struct TodoTable table;
+  struct Index idx;
+  bool fresh = true;
+  if (doc_open(&doc, path)) {
+    if (index_open(&idx, path, &doc.st)) {
+      struct IndexEntry *entries = NULL;
+      if (list_todos(&doc, &table)) {
+        entries = index_entries(&doc, &table);
+        fresh = entries && idx.count == table.count &&
+                memcmp(idx.entries, entries,
+                       table.count * sizeof(*entries)) == 0;
+        free_table(&table);
+      }
+      free(entries);
+      index_close(&idx);
+    }
+    doc_close(&doc);
+  }
+  lock_release(&lock);
+  return fresh;
+}
+
+// One reader, every parse must see a whole file with every generated task.
+// With an index, reads go through it and rebuild it when it is stale.
+void stress_reader(const char *path, const struct BenchConfig *cfg,
+                   struct Stress *shared, struct StressSlot *slot) {
+  while (!atomic_load(&shared->stop)) {
+    struct Document doc;
+    struct TodoTable table;
+    if (!doc_load(&doc, path)) {
+      slot->errors++;
+      continue;
+    }
+    bool ok = cfg->index ? load_todos(&doc, path, &table)
+                         : list_todos(&doc, &table);
+    if (ok) {
+      slot->errors += table.count < cfg->tasks;
+      free_table(&table);
+    } else {
+      slot->errors++;
+    }
+    doc_close(&doc);
+
+    slot->ops++;
+    if (cfg->index && slot->ops % STRESS_VERIFY_EVERY == 0) {
+      slot->stale += !stress_verify_index(path);
+    }
+  }
+}
+
+// Count the stress tasks found in path, seen[w * iterations + j] for task
+// "stress w.j"
+bool stress_check(const char *path, const struct BenchConfig *cfg,
+                  uint32_t *seen) {
+  struct Document doc;
+  struct TodoTable table;
+  if (!doc_load(&doc, path)) {
+    return false;
+  }
+  if (!list_todos(&doc, &table)) {
+    doc_close(&doc);
+    return false;
+  }
+
+  size_t tag = sizeof(STRESS_TAG) - 1;
+  for (size_t i = 0; i < table.count; i++) {
+    const char *text = doc.data + table.offsets[i];
+    size_t writer, op;
+    if (table.lengths[i] > tag && memcmp(text, STRESS_TAG, tag) == 0 &&
+        sscanf(text + tag, "%zu.%zu", &writer, &op) == 2 &&
+        writer < cfg->writers && op < cfg->iterations) {
+      seen[writer * cfg->iterations + op]++;
+    }
+  }
+
+  free_table(&table);
+  doc_close(&doc);
+  return true;
+}
+
+// Run the stress mode and print its JSON report
+int run_stress(const char *path, const struct BenchConfig *cfg, FILE *out) {
+  struct Stress *shared = mmap(NULL, sizeof(*shared), PROT_READ | PROT_WRITE,
+                               MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  size_t expected = cfg->writers * cfg->iterations;
+  uint32_t *seen = calloc(expected, sizeof(*seen));
+  if (shared == MAP_FAILED || !seen) {
+    fprintf(stderr, "td_bench: out of memory\n");
+    return EXIT_FAILURE;
+  }
+
+  if (cfg->index && !build_index(path)) {
+    fprintf(stderr, "td_bench: could not index %s\n", path);
+    return EXIT_FAILURE;
+  }
+
+  // Conflicts are expected here, td's own messages would only be noise
+  quiet_errors_begin();
+
+  pid_t readers[MAX_STRESS_PROCS], writers[MAX_STRESS_PROCS];
+  for (size_t i = 0; i < cfg->readers; i++) {
+    if ((readers[i] = fork()) == 0) {
+      stress_reader(path, cfg, shared, &shared->readers[i]);
+      _exit(EXIT_SUCCESS);
+    }
+  }
+
+  uint64_t start = now_ns();
+  for (size_t i = 0; i < cfg->writers; i++) {
+    if ((writers[i] = fork()) == 0) {
+      stress_writer(path, cfg, i, &shared->writers[i]);
+      _exit(EXIT_SUCCESS);
+    }
+  }
+  for (size_t i = 0; i < cfg->writers; i++) {
+    waitpid(writers[i], NULL, 0);
+  }
+  double seconds = (now_ns() - start) / 1e9;
+
+  atomic_store(&shared->stop, true);
+  for (size_t i = 0; i < cfg->readers; i++) {
+    waitpid(readers[i], NULL, 0);
+  }
+
+  struct StressSlot w = {0}, r = {0};
+  for (size_t i = 0; i < cfg->writers; i++) {
+    w.ops += shared->writers[i].ops;
+    w.retries += shared->writers[i].retries;
+    w.errors += shared->writers[i].errors;
+  }
+  for (size_t i = 0; i < cfg->readers; i++) {
+    r.ops += shared->readers[i].ops;
+    r.errors += shared->readers[i].errors;
+    r.stale += shared->readers[i].stale;
+  }
+
+  size_t lost = 0, duplicated = 0;
+  bool checked = stress_check(path, cfg, seen);
+  for (size_t i = 0; checked && i < expected; i++) {
+    lost += seen[i] == 0;
+    duplicated += seen[i] > 1;
+  }
+
+  fprintf(out, "{\n");
+  fprintf(out, "  \"version\": \"%s\",\n", PROJECT_VERSION);
+  fprintf(out, "  \"stress\": {\n");
+  fprintf(out, "    \"tasks\": %zu,\n", cfg->tasks);
+  fprintf(out, "    \"writers\": %zu,\n", cfg->writers);
+  fprintf(out, "    \"readers\": %zu,\n", cfg->readers);
+  fprintf(out, "    \"journal\": %s,\n", cfg->journal ? "true" : "false");
+  fprintf(out, "    \"index\": %s,\n", cfg->index ? "true" : "false");
+  fprintf(out, "    \"ops_per_writer\": %zu,\n", cfg->iterations * 2);
+  fprintf(out, "    \"seconds\": %.3f,\n", seconds);
+  fprintf(out, "    \"writes_per_s\": %.0f,\n",
+          seconds > 0 ? w.ops / seconds : 0);
+  fprintf(out, "    \"reads_per_s\": %.0f,\n",
+          seconds > 0 ? r.ops / seconds : 0);
+  fprintf(out, "    \"commit_retries\": %llu,\n",
+          (unsigned long long)w.retries);
+  fprintf(out, "    \"write_errors\": %llu,\n", (unsigned long long)w.errors);
+  fprintf(out, "    \"read_errors\": %llu,\n", (unsigned long long)r.errors);
+  fprintf(out, "    \"lost_updates\": %zu,\n", lost);
+  fprintf(out, "    \"duplicated_updates\": %zu,\n", duplicated);
+  fprintf(out, "    \"stale_indexes\": %llu\n", (unsigned long long)r.stale);
+  fprintf(out, "  }\n}\n");
+
+  free(seen);
+  munmap(shared, sizeof(*shared));
+
+  bool ok = checked && lost == 0 && duplicated == 0 && w.errors == 0 &&
+            r.errors == 0 && r.stale == 0;
+  if (!ok) {
+    fprintf(stderr, "td_bench: stress run lost or corrupted updates\n");
+  }
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// Scanner check mode: every scanner the CPU runs must report the same lines
+// as the scalar one. Buffers end right before a guard page so reads past
+// the end fault, and ranges start and stop at random offsets.
+int run_check_scan(const struct BenchConfig *cfg, FILE *out) {
+  static const char *names[] = {"scalar", "sse2", "avx2"};
+  static const char alphabet[] = "\n\n\n- [x] a";
+  long page = sysconf(_SC_PAGESIZE);
+  size_t span = (CHECK_SPAN + page - 1) / page * page;
+  char *region = mmap(NULL, span + page, PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  size_t *want = malloc((CHECK_SPAN + 1) * sizeof(*want));
+  size_t *got = malloc((CHECK_SPAN + 1) * sizeof(*got));
+  if (region == MAP_FAILED || !want || !got ||
+      mprotect(region + span, page, PROT_NONE) != 0) {
+    fprintf(stderr, "td_bench: out of memory\n");
+    return EXIT_FAILURE;
+  }
+
+  newline_fn scanners[3];
+  size_t count = 0;
+  for (size_t i = 0; i < sizeof(names) / sizeof(*names); i++) {
+    if ((scanners[count] = scan_impl(names[i]))) {
+      names[count++] = names[i];
+    }
+  }
+
+  uint64_t state = cfg->seed ? cfg->seed : 1;
+  size_t comparisons = 0, mismatches = 0;
+  for (size_t round = 0; round < cfg->check_scan; round++) {
+    // Mostly short buffers, where the tails and block edges are
+    size_t size = next_random(&state) % (round % 16 ? 300 : CHECK_SPAN);
+    char *data = region + span - size;
+    for (size_t i = 0; i < size; i++) {
+      data[i] = alphabet[next_random(&state) % (sizeof(alphabet) - 1)];
+    }
+
+    size_t from = size ? next_random(&state) % (size + 1) : 0;
+    size_t end = from + next_random(&state) % (size - from + 1);
+    size_t maxes[] = {1, 3, SCAN_BATCH, size + 1};
+    size_t max = maxes[next_random(&state) % 4];
+
+    size_t n = scanners[0](data, from, end, want, max);
+    for (size_t k = 1; k < count; k++) {
+      size_t m = scanners[k](data, from, end, got, max);
+      comparisons++;
+      if (m != n || memcmp(want, got, n * sizeof(*want)) != 0) {
+        if (mismatches++ == 0) {
+          fprintf(stderr,
+                  "td_bench: %s differs from scalar on round %zu "
+                  "(size %zu, from %zu, end %zu, max %zu)\n",
+                  names[k], round, size, from, end, max);
+        }
+      }
+    }
+  }
+
+  fprintf(out, "{\n");
+  fprintf(out, "  \"version\": \"%s\",\n", PROJECT_VERSION);
+  fprintf(out, "  \"check_scan\": {\n");
+  fprintf(out, "    \"scanners\": [");
+  for (size_t k = 0; k < count; k++) {
+    fprintf(out, "%s\"%s\"", k ? ", " : "", names[k]);
+  }
+  fprintf(out, "],\n");
+  fprintf(out, "    \"rounds\": %zu,\n", cfg->check_scan);
+  fprintf(out, "    \"comparisons\": %zu,\n", comparisons);
+  fprintf(out, "    \"mismatches\": %zu\n", mismatches);
+  fprintf(out, "  }\n}\n");
+
+  free(want);
+  free(got);
+  munmap(region, span + page);
+  return mismatches == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+// Append the statistics of one benchmark to the report
+void report_samples(FILE *out, struct Samples *s, bool last) {
+  qsort(s->ns, s->count, sizeof(*s->ns), compare_u64);
+
+  uint64_t total = 0;
+  for (size_t i = 0; i < s->count; i++) {
+    total += s->ns[i];
+  }
+  double mean = s->count ? (double)total / s->count : 0;
+  double seconds = mean / 1e9;
+
+  fprintf(out, "    \"%s\": {\n", s->name);
+  fprintf(out, "      \"iterations\": %zu,\n", s->count);
+  fprintf(out, "      \"mean_ns\": %.0f,\n", mean);
+  if (s->count > 0) {
+    fprintf(out, "      \"min_ns\": %llu,\n",
+            (unsigned long long)s->ns[0]);
+    fprintf(out, "      \"p50_ns\": %llu,\n",
+            (unsigned long long)percentile(s, 0.50));
+    fprintf(out, "      \"p90_ns\": %llu,\n",
+            (unsigned long long)percentile(s, 0.90));
+    fprintf(out, "      \"p99_ns\": %llu,\n",
+            (unsigned long long)percentile(s, 0.99));
+    fprintf(out, "      \"max_ns\": %llu,\n",
+            (unsigned long long)s->ns[s->count - 1]);
+  }
+  fprintf(out, "      \"mb_per_s\": %.2f,\n",
+          seconds > 0 ? s->bytes / seconds / 1e6 : 0);
+  fprintf(out, "      \"tasks_per_s\": %.0f\n",
+          seconds > 0 ? s->items / seconds : 0);
+  fprintf(out, "    }%s\n", last ? "" : ",");
+}
+
+void print_usage(const char *name) {
+  printf("Usage: %s [OPTIONS]\n\n", name);
+  printf("  %-25s %s\n", "--tasks <n>", "Tasks to generate (default 100000)");
+  printf("  %-25s %s\n", "--line-length <n>",
+         "Average task length in bytes (default 48)");
+  printf("  %-25s %s\n", "--done-ratio <r>",
+         "Share of completed tasks (default 0.3)");
+  printf("  %-25s %s\n", "--preamble <n>",
+         "Bytes of notes before the tasks (default 1024)");
+  printf("  %-25s %s\n", "--utf8 <r>",
+         "Share of non-ASCII words (default 0.2)");
+  printf("  %-25s %s\n", "--seed <n>", "Generator seed (default 42)");
+  printf("  %-25s %s\n", "--iterations <n>",
+         "Samples per benchmark (default 20)");
+  printf("  %-25s %s\n", "--dir <path>",
+         "Where to put generated files (default /tmp)");
+  printf("  %-25s %s\n", "--output <path>",
+         "Write the JSON report there instead of stdout");
+  printf("  %-25s %s\n", "--journal <0|1>",
+         "Append mutations to the journal instead of rewriting (default 0)");
+  printf("  %-25s %s\n", "--stress <n>",
+         "Race n writer processes instead, each doing 2 x iterations "
+         "updates, and fail if one is lost");
+  printf("  %-25s %s\n", "--readers <n>",
+         "Reader processes parsing the file during --stress (default 0)");
+  printf("  %-25s %s\n", "--index <0|1>",
+         "Keep a sidecar index during --stress, readers load through it and "
+         "check it against the file (default 0)");
+  printf("  %-25s %s\n", "--check-scan <n>",
+         "Compare every newline scanner against the scalar one on n random "
+         "buffers instead, and fail if one differs");
+}
+
+// Parse the command line, false on bad usage
+bool parse_args(int argc, char **argv, struct BenchConfig *cfg) {
+  for (int i = 1; i < argc; i++) {
+    const char *opt = argv[i];
+    if (strcmp(opt, "-h") == 0 || strcmp(opt, "--help") == 0) {
+      print_usage(argv[0]);
+      exit(EXIT_SUCCESS);
+    }
+    if (i == argc - 1) {
+      return false;
+    }
+
+    const char *value = argv[++i];
+    if (strcmp(opt, "--tasks") == 0) {
+      cfg->tasks = strtoull(value, NULL, 10);
+    } else if (strcmp(opt, "--line-length") == 0) {
+      cfg->line_length = strtoull(value, NULL, 10);
+    } else if (strcmp(opt, "--done-ratio") == 0) {
+      cfg->done_ratio = strtod(value, NULL);
+    } else if (strcmp(opt, "--preamble") == 0) {
+      cfg->preamble = strtoull(value, NULL, 10);
+    } else if (strcmp(opt, "--utf8") == 0) {
+      cfg->utf8_ratio = strtod(value, NULL);
+    } else if (strcmp(opt, "--seed") == 0) {
+      cfg->seed = strtoull(value, NULL, 10);
+    } else if (strcmp(opt, "--iterations") == 0) {
+      cfg->iterations = strtoull(value, NULL, 10);
+    } else if (strcmp(opt, "--dir") == 0) {
+      cfg->dir = value;
+    } else if (strcmp(opt, "--output") == 0) {
+      cfg->output = value;
+    } else if (strcmp(opt, "--journal") == 0) {
+      cfg->journal = strtoul(value, NULL, 10) != 0;
+    } else if (strcmp(opt, "--index") == 0) {
+      cfg->index = strtoul(value, NULL, 10) != 0;
+    } else if (strcmp(opt, "--stress") == 0) {
+      cfg->writers = strtoull(value, NULL, 10);
+    } else if (strcmp(opt, "--readers") == 0) {
+      cfg->readers = strtoull(value, NULL, 10);
+    } else if (strcmp(opt, "--check-scan") == 0) {
+      cfg->check_scan = strtoull(value, NULL, 10);
+    } else {
+      return false;
+    }
+  }
+  return cfg->tasks > 0 && cfg->iterations > 0 &&
+         cfg->iterations <= MAX_SAMPLES && cfg->writers <= MAX_STRESS_PROCS &&
+         cfg->readers <= MAX_STRESS_PROCS;
+}
+
+int main(int argc, char **argv) {
+  struct BenchConfig cfg = {
+      .tasks = 100000,
+      .line_length = 48,
+      .done_ratio = 0.3,
+      .preamble = 1024,
+      .utf8_ratio = 0.2,
+      .seed = 42,
+      .iterations = 20,
+      .dir = "/tmp",
+  };
+  if (!parse_args(argc, argv, &cfg)) {
+    fprintf(stderr, "td_bench: invalid arguments, see --help\n");
+    return EXIT_FAILURE;
+  }
+  set_journal_mode(cfg.journal);
+
+  if (cfg.check_scan > 0) {
+    FILE *out = cfg.output ? fopen(cfg.output, "w") : stdout;
+    int status = out ? run_check_scan(&cfg, out) : EXIT_FAILURE;
+    if (!out) {
+      fprintf(stderr, "td_bench: %s: %s\n", cfg.output, strerror(errno));
+    } else if (out != stdout) {
+      fclose(out);
+    }
+    return status;
+  }
+
+  char source[4096], work[4096];
+  snprintf(source, sizeof(source), "%s/td-bench-%d.md", cfg.dir, getpid());
+  snprintf(work, sizeof(work), "%s/td-bench-%d-work.md", cfg.dir, getpid());
+
+  uint64_t start = now_ns();
+  if (!generate(source, &cfg)) {
+    return EXIT_FAILURE;
+  }
+  uint64_t generate_ns = now_ns() - start;
+
+  if (cfg.writers > 0) {
+    FILE *out = cfg.output ? fopen(cfg.output, "w") : stdout;
+    int status = out ? run_stress(source, &cfg, out) : EXIT_FAILURE;
+    if (!out) {
+      fprintf(stderr, "td_bench: %s: %s\n", cfg.output, strerror(errno));
+    } else if (out != stdout) {
+      fclose(out);
+    }
+    remove_generated(source);
+    return status;
+  }
+
+  struct Samples parse, render, write, add, done, remove;
+  if (!samples_init(&parse, "parse", cfg.iterations) ||
+      !samples_init(&render, "render", cfg.iterations) ||
+      !samples_init(&write, "write", cfg.iterations) ||
+      !samples_init(&add, "add", cfg.iterations) ||
+      !samples_init(&done, "done", cfg.iterations) ||
+      !samples_init(&remove, "remove", cfg.iterations)) {
+    fprintf(stderr, "td_bench: out of memory\n");
+    return EXIT_FAILURE;
+  }
+
+  bool ok = true;
+  uint64_t state = cfg.seed ? cfg.seed : 1;
+  int sink = open("/dev/null", O_WRONLY);
+
+  struct Document doc;
+  struct TodoTable table;
+  if (!doc_open(&doc, source) || !list_todos(&doc, &table)) {
+    return EXIT_FAILURE;
+  }
+
+  for (size_t i = 0; ok && i < cfg.iterations; i++) {
+    ok = bench_parse(source, &parse) &&
+         bench_render(&doc, &table, sink, &render) &&
+         bench_write(&doc, &table, work, &write);
+  }
+
+  // Mutations run on a private copy of the document
+  ok = ok && copy_file(source, work);
+  for (size_t i = 0; ok && i < cfg.iterations; i++) {
+    ok = bench_add(work, &add) && bench_done(work, cfg.tasks, &state, &done);
+  }
+  ok = ok && copy_file(source, work);
+  for (size_t i = 0; ok && i < cfg.iterations && i < cfg.tasks; i++) {
+    ok = bench_remove(work, cfg.tasks, &state, &remove);
+  }
+
+  size_t size = doc.size;
+  free_table(&table);
+  doc_close(&doc);
+  close(sink);
+  remove_generated(source);
+  remove_generated(work);
+
+  if (!ok) {
+    fprintf(stderr, "\ntd_bench: a benchmark failed\n");
+    return EXIT_FAILURE;
+  }
+
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+
+  FILE *out = cfg.output ? fopen(cfg.output, "w") : stdout;
+  if (!out) {
+    fprintf(stderr, "td_bench: %s: %s\n", cfg.output, strerror(errno));
+    return EXIT_FAILURE;
+  }
+
+  fprintf(out, "{\n");
+  fprintf(out, "  \"version\": \"%s\",\n", PROJECT_VERSION);
+  fprintf(out, "  \"scanner\": \"%s\",\n", scan_impl_name());
+  fprintf(out, "  \"config\": {\n");
+  fprintf(out, "    \"tasks\": %zu,\n", cfg.tasks);
+  fprintf(out, "    \"line_length\": %zu,\n", cfg.line_length);
+  fprintf(out, "    \"done_ratio\": %.3f,\n", cfg.done_ratio);
+  fprintf(out, "    \"preamble\": %zu,\n", cfg.preamble);
+  fprintf(out, "    \"utf8_ratio\": %.3f,\n", cfg.utf8_ratio);
+  fprintf(out, "    \"seed\": %llu,\n", (unsigned long long)cfg.seed);
+  fprintf(out, "    \"iterations\": %zu,\n", cfg.iterations);
+  fprintf(out, "    \"journal\": %s\n", cfg.journal ? "true" : "false");
+  fprintf(out, "  },\n");
+  fprintf(out, "  \"file_bytes\": %zu,\n", size);
+  fprintf(out, "  \"generate_ns\": %llu,\n", (unsigned long long)generate_ns);
+  fprintf(out, "  \"peak_rss_kb\": %ld,\n", usage.ru_maxrss);
+  fprintf(out, "  \"benchmarks\": {\n");
+  report_samples(out, &parse, false);
+  report_samples(out, &render, false);
+  report_samples(out, &write, false);
+  report_samples(out, &add, false);
+  report_samples(out, &done, false);
+  report_samples(out, &remove, true);
+  fprintf(out, "  }\n}\n");
+
+  if (out != stdout) {
+    fclose(out);
+  }
+
+  struct Samples *all[] = {&parse, &render, &write, &add, &done, &remove};
+  for (size_t i = 0; i < sizeof(all) / sizeof(*all); i++) {
+    free(all[i]->ns);
+  }
+  return EXIT_SUCCESS;
+}
@@ -24,24 +24,41 @@
 
 #include <ctype.h>
 #include <errno.h>
+#include <stdarg.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <uthash.h>
-#include <utlist.h>
+#include <unistd.h>
 
 #include "project.h"
+#include "services/batch.h"
+#include "services/daemon.h"
+#include "services/journal.h"
+#include "services/meta.h"
 #include "services/storage.h"
+#include "services/tally.h"
+#include "services/watch.h"
+#include "services/workspace.h"
+#include "utils/bitmap.h"
 #include "utils/fmt.h"
+#include "utils/render.h"
+#include "utils/serialize.h"
+#include "utils/stats.h"
+
+#define DAEMON_UNKNOWN -2 // Not connected yet
 
 typedef struct {
-  char *name; // key
+  char *name;
   char *value;
-  UT_hash_handle hh;
 } arg;
 
+static enum Format output = FORMAT_TABLE;
+static struct Serializer results; // Outcomes of commands in machine formats
+static bool results_open;
+static bool journal; // --journal, mutations are appended locally
+
 // Print help message
 void print_help(char *name) {
   puts(PROJECT_DESCRIPTION "\n");
@@ -54,217 +71,783 @@ void print_help(char *name) {
          "Create TODO.md in the current directory");
   printf("  %-25s %s\n", "add <task>", "Add a new task to TODO.md");
   printf("  %-25s %s\n", "list", "Display all tasks");
+  printf("  %-25s %s\n", "list --count", "Print the number of tasks");
+  printf("  %-25s %s\n", "list --limit <n>",
+         "Show at most n tasks, stop reading the file after them");
+  printf("  %-25s %s\n", "list --offset <n>", "Skip the first n tasks");
+  printf("  %-25s %s\n", "list --tail <n>", "Show the last n tasks");
+  printf("  %-25s %s\n", "list --grep <text>",
+         "Show only tasks containing text");
+  printf("  %-25s %s\n", "list --regex <re>",
+         "Show only tasks matching an extended regular expression");
+  printf("  %-25s %s\n", "list --status <status>",
+         "Show only open or done tasks");
+  printf("  %-25s %s\n", "list --tag <tag>",
+         "Show only tasks tagged #tag");
+  printf("  %-25s %s\n", "list --sort <keys>",
+         "Order by priority, due, status or id, comma separated, -key "
+         "reverses one (e.g., \"priority,due\")");
+  printf("  %-25s %s\n", "list --recursive <dir>",
+         "Show the tasks of every TODO.md under dir as path:id rows");
+  printf("  %-25s %s\n", "list --exclude <pattern>",
+         "Skip paths matching a .gitignore-style pattern while walking "
+         "(repeatable, .gitignore files are honoured too)");
+  printf("  %-25s %s\n", "stats",
+         "Print how many tasks are open and done");
+  printf("  %-25s %s\n", "stats --sections",
+         "Also count the tasks under each heading");
+  printf("  %-25s %s\n", "stats --recursive <dir>",
+         "Count the tasks of every TODO.md under dir");
   printf("  %-25s %s\n", "done <id>",
          "Mark the task with ID <id> as completed");
+  printf("  %-25s %s\n", "undone <id>",
+         "Mark the task with ID <id> as not completed");
   printf("  %-25s %s\n", "remove <id>", "Remove the task with ID <id>");
   printf("  %-25s %s\n", "clear", "Remove all tasks from TODO.md");
+  printf("  %-25s %s\n", "batch [script]",
+         "Apply add/done/undone/remove/clear lines from script (or stdin) "
+         "with one write");
+  printf("  %-25s %s\n", "compact",
+         "Fold the journal back into TODO.md with one rewrite");
+  printf("  %-25s %s\n", "watch",
+         "Show the tasks and redraw the rows that change whenever TODO.md "
+         "is saved");
+  printf("  %-25s %s\n", "serve",
+         "Keep parsed files in memory and answer other td commands "
+         "(disable with TD_NO_DAEMON=1)");
 
   puts("\n" STYLE_BOLD STYLE_UNDERLINE "Arguments:" STYLE_RESET);
-  printf("  %-25s %s\n", "task", "The task description (e.g., \"Learn C\")");
+  printf("  %-25s %s\n", "task",
+         "The task description (e.g., \"Learn C\"), may carry a priority "
+         "!p0-!p9, a due date @due(YYYY-MM-DD) and #tags");
   printf("  %-25s %s\n", "title",
          "The heading for TODO.md (e.g., \"Planned features\")");
   printf("  %-25s %s\n", "id...",
-         "The task ID (e.g., the number from the task list)");
+         "Task IDs, ranges or keywords separated by commas (e.g., "
+         "\"1,4-6\", \"10-\", \"done\", \"open\", \"all\"), or "
+         "path:id... to target a file found by --recursive");
 
   puts("\n" STYLE_BOLD STYLE_UNDERLINE "Options:" STYLE_RESET);
   printf("  %-25s %s\n", "-f, --file <path>",
          "Specify a custom TODO.md file path (defaults to TODO.md in the "
          "current directory)");
+  printf("  %-25s %s\n", "-s, --sync <mode>",
+         "Durability of rewrites: none, file or dir (defaults to none)");
+  printf("  %-25s %s\n", "-j, --journal",
+         "Append changes to a journal next to TODO.md instead of rewriting "
+         "it, compacted automatically once it grows");
+  printf("  %-25s %s\n", "-i, --index",
+         "Keep a sidecar index of task offsets for fast lookups by ID");
+  printf("  %-25s %s\n", "--format <format>",
+         "Print tasks and command results as table, json, ndjson or tsv");
+  printf("  %-25s %s\n", "-t, --threads <n>",
+         "Number of threads used to parse large files (defaults to auto)");
+  printf("  %-25s %s\n", "--stats",
+         "Print phase timings, I/O and arena counters to stderr "
+         "(TD_TRACE=<file> appends them as a Chrome trace)");
   printf("  %-25s %s\n", "-h, --help", "Show this help message");
   printf("  %-25s %s\n", "-v, --version", "Display the program version");
 }
 
-// Add new argument to hash table
-void add_argument(arg **arguments, char *name, char *value) {
-  arg *new_arg;
+// Add new argument, commands run in the order they were given
+void add_argument(arg *arguments, int *count, char *name, char *value) {
+  arguments[*count].name = name;
+  arguments[*count].value = value;
+  (*count)++;
+}
 
-  HASH_FIND_STR(*arguments, name, new_arg);
+// Parse the count given to --limit, --offset or --tail, false unless the
+// whole argument is a number that fits
+bool parse_count(const char *text, size_t *out) {
+  if (!isdigit((unsigned char)*text)) {
+    return false; // strtoull would take "-1" and " 5"
+  }
 
-  if (new_arg == NULL) {
-    new_arg = (arg *)malloc(sizeof(arg));
-    new_arg->name = name;
-    new_arg->value = value;
-    HASH_ADD_STR(*arguments, name, new_arg);
-  } else {
-    new_arg->value = value;
+  char *end;
+  errno = 0;
+  unsigned long long value = strtoull(text, &end, 10);
+  if (errno != 0 || *end != '\0' || value > SIZE_MAX) {
+    return false;
   }
+  *out = value;
+  return true;
 }
 
-// Release hash table memory
-void hash_release(arg **arguments) {
-  if (arguments == NULL) {
+// Tell how a command went, as a message for people or as one record in
+// machine formats. Failures were already explained on stderr.
+void report(const char *command, const char *value, const char *path,
+            bool ok, const char *format, ...) {
+  if (output == FORMAT_TABLE) {
+    if (!ok) {
+      return;
+    }
+
+    char *message;
+    va_list args;
+    va_start(args, format);
+    int len = vasprintf(&message, format, args);
+    va_end(args);
+    if (len >= 0) {
+      print_info("%s", message);
+      free(message);
+    }
     return;
   }
 
-  arg *current, *tmp;
+  if (!results_open) {
+    results_open = serializer_begin(&results, STDOUT_FILENO, output);
+  }
+  if (results_open) {
+    serialize_result(&results, command, value, path, ok);
+  }
+}
 
-  HASH_ITER(hh, *arguments, current, tmp) {
-    HASH_DEL(*arguments, current);
-    free(current);
+// Write out the command records gathered so far
+void finish_results(void) {
+  if (results_open) {
+    serializer_end(&results);
+    results_open = false;
   }
 }
 
-uint32_t *parse_ids(const char *val, int *returnSize) {
-  uint32_t *ids = NULL;
-  int count = 0;
+// Apply the operations read from script to path with a single commit
+bool run_batch(FILE *script, const char *name, const char *path,
+               enum Durability durability) {
+  struct Batch batch;
+  if (!batch_open(&batch, path)) {
+    report("batch", name, path, false, NULL);
+    return false;
+  }
 
-  char buffer[1024];
-  size_t j = 0;
+  char *line = NULL;
+  size_t cap = 0;
+  ssize_t len;
+  size_t line_no = 0, applied = 0;
+  bool ok = true;
 
-  for (size_t i = 0; i <= strlen(val); i++) {
-    if (isdigit(val[i])) {
+  while (ok && (len = getline(&line, &cap, script)) != -1) {
+    line_no++;
+    while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r')) {
+      line[--len] = '\0';
+    }
+
+    char *op = line + strspn(line, " \t");
+    if (*op == '\0' || *op == '#') { // Blank line or comment
       continue;
     }
 
-    if (val[i] == ',' || val[i] == '\0') {
-      if (i == j) { // Consecutive commas or empty number
-        print_err("Invalid syntax (empty number between commas).");
-        returnSize = 0;
-        free(ids);
-        return NULL;
-      }
-      size_t num_len = i - j;
-      if (num_len >= sizeof(buffer)) {
-        print_err("Number too large.");
-        returnSize = 0;
-        free(ids);
-        return NULL;
-      }
-      strncpy(buffer, val + j, num_len);
-      buffer[num_len] = '\0';
-      j = i + 1;
-      ids = realloc(ids, sizeof(int) * (count + 1));
-      ids[count++] = atoi(buffer);
-    } else {
-      print_err("Invalid character in argument.");
-      returnSize = 0;
-      free(ids);
-      return NULL;
+    char *rest = op + strcspn(op, " \t");
+    if (*rest != '\0') {
+      *rest++ = '\0';
+      rest += strspn(rest, " \t");
+    }
+
+    ok = batch_apply(&batch, op, rest);
+
+    if (!ok) {
+      char message[64];
+      snprintf(message, sizeof(message), "Invalid operation on line %zu.",
+               line_no);
+      print_err(message);
+      break;
     }
+    applied++;
   }
 
-  *returnSize = count;
-  return ids;
+  free(line);
+
+  ok = ok && batch_commit(&batch, durability);
+  report("batch", name, path, ok, "Applied %zu operations to %s", applied,
+         path);
+
+  batch_close(&batch);
+  return ok;
 }
 
-void exec(arg **arguments, const char *path) {
-  arg *current, *tmp;
+// Forward op to a running daemon, false if the command must run locally
+bool call_daemon(int *daemon, const char *op, const char *path,
+                 const char *value, enum Durability durability,
+                 struct DaemonReply *reply) {
+  if (*daemon == DAEMON_UNKNOWN) {
+    *daemon = daemon_connect();
+  }
+  if (*daemon < 0) {
+    return false;
+  }
 
-  HASH_ITER(hh, *arguments, current, tmp) {
-    if (strcmp(current->name, "init") == 0) {
-      if (init(path, current->value)) {
-        print_info("Initialized todos at %s", path);
-      }
-    } else if (strcmp(current->name, "add") == 0) {
-      if (add_todo(path, current->value, false)) {
-        print_info("Added '%s' task to %s", current->value, path);
-      }
-    } else { // remove or done command
-      char *val = current->value;
+  // The daemon does not share our working directory
+  char *real_path = realpath(path, NULL);
+  if (!real_path) {
+    return false;
+  }
 
-      int returnSize;
-      uint32_t *ids = parse_ids(val, &returnSize);
-      struct TodoNode *todos = list_todos(path);
-      struct TodoNode *elt, *tmp;
+  bool ok = daemon_call(*daemon, op, real_path, value, durability, reply);
+  free(real_path);
+  if (!ok) { // The daemon went away, run everything locally from now on
+    close(*daemon);
+    *daemon = -1;
+  }
+  return ok;
+}
 
-      if (!ids || !todos) {
-        break;
-      }
+// Run a mutating command through the daemon, false if it must run locally
+bool exec_remote(int *daemon, arg *current, const char *path,
+                 enum Durability durability) {
+  struct DaemonReply reply;
+  if (!call_daemon(daemon, current->name, path, current->value, durability,
+                   &reply)) {
+    return false;
+  }
 
-      for (int i = 0; i < returnSize; i++) {
-        DL_FOREACH_SAFE(todos, elt, tmp) {
-          if (elt->todo.id == ids[i]) {
-            if (strcmp(current->name, "done") == 0) {
-              elt->todo.is_done = true;
-            } else {
-              DL_DELETE(todos, elt);
-              free(elt);
-            }
-          }
-        }
+  if (!reply.ok) {
+    print_err(reply.data);
+  }
+  if (strcmp(current->name, "add") == 0) {
+    report(current->name, current->value, path, reply.ok,
+           "Added '%s' task to %s", current->value, path);
+  } else {
+    report(current->name, current->value, path, reply.ok, "Updated %s",
+           path);
+  }
+  daemon_reply_free(&reply);
+  return true;
+}
+
+// Run one command, false if the commands after it must not run
+bool exec_command(arg *current, const char *path, enum Durability durability,
+                  int *daemon) {
+  if (strcmp(current->name, "init") == 0) {
+    bool ok = init(path, current->value, durability);
+    report(current->name, current->value, path, ok,
+           "Initialized todos at %s", path);
+  } else if (strcmp(current->name, "compact") == 0) {
+    bool ok = journal_compact(path, durability);
+    report(current->name, NULL, path, ok, "Compacted %s", path);
+  } else if (strcmp(current->name, "batch") != 0 && !journal &&
+             exec_remote(daemon, current, path, durability)) {
+    return true;
+  } else if (strcmp(current->name, "add") == 0) {
+    bool ok = add_todo(path, current->value, false);
+    report(current->name, current->value, path, ok,
+           "Added '%s' task to %s", current->value, path);
+  } else if (strcmp(current->name, "batch") == 0) {
+    bool from_stdin = strcmp(current->value, "-") == 0;
+    FILE *script = from_stdin ? stdin : fopen(current->value, "r");
+    if (!script) {
+      print_err(strerror(errno));
+      report(current->name, current->value, path, false, NULL);
+      return false;
+    }
+
+    bool ok = run_batch(script, current->value, path, durability);
+    if (!from_stdin) {
+      fclose(script);
+    }
+    return ok;
+  } else if (strcmp(current->name, "done") == 0 ||
+             strcmp(current->name, "undone") == 0) {
+    struct Selector sel;
+    if (!selector_parse(&sel, current->value)) {
+      report(current->name, current->value, path, false, NULL);
+      return false;
+    }
+
+    // Only the checkbox byte changes, patch it instead of rewriting
+    bool is_done = strcmp(current->name, "done") == 0;
+    bool ok = set_status(path, &sel, is_done, durability);
+    report(current->name, current->value, path, ok, "Updated %s", path);
+    selector_free(&sel);
+  } else { // remove command
+    struct Selector sel;
+    if (!selector_parse(&sel, current->value)) {
+      report(current->name, current->value, path, false, NULL);
+      return false;
+    }
+
+    bool ok = remove_todos(path, &sel, durability);
+    report(current->name, current->value, path, ok, "Updated %s", path);
+    selector_free(&sel);
+  }
+  return true;
+}
+
+// Split a "path:id" target as printed by list --recursive, the path
+// before the last colon replaces the file the command runs on
+char *_split_target(arg *current, arg *local) {
+  *local = *current;
+  bool addressed = strcmp(current->name, "done") == 0 ||
+                   strcmp(current->name, "undone") == 0 ||
+                   strcmp(current->name, "remove") == 0;
+  char *colon = addressed ? strrchr(current->value, ':') : NULL;
+  if (!colon || colon == current->value) {
+    return NULL;
+  }
+
+  local->value = colon + 1;
+  return strndup(current->value, colon - current->value);
+}
+
+void exec(arg *arguments, int count, const char *path,
+          enum Durability durability, int *daemon) {
+  for (int n = 0; n < count; n++) {
+    arg current;
+    char *target = _split_target(&arguments[n], &current);
+    size_t span = stats_begin(current.name);
+    bool ok = exec_command(&current, target ? target : path, durability,
+                           daemon);
+    stats_end(span);
+    free(target);
+    if (!ok) {
+      break;
+    }
+  }
+}
+
+// Render the tasks of the table from position first on into one buffer
+// and write it with a single call
+void print_todos(const struct Document *doc, const struct TodoTable *todos,
+                 size_t first) {
+  uint32_t max_id = 0;
+  size_t max_width = 0;
+  for (size_t i = first; i < todos->count; i++) {
+    size_t width =
+        display_width(doc->data + todos->offsets[i], todos->lengths[i]);
+    max_id = todos->ids[i] > max_id ? todos->ids[i] : max_id;
+    max_width = width > max_width ? width : max_width;
+  }
+
+  size_t span = stats_begin("render");
+  struct Render r;
+  if (render_begin(&r, STDOUT_FILENO, max_id, max_width)) {
+    for (size_t i = first; i < todos->count; i++) {
+      render_row(&r, todos->ids[i], doc->data + todos->offsets[i],
+                 todos->lengths[i], bitmap_get(todos->done, i));
+    }
+  }
+  render_end(&r);
+  stats_end(span);
+}
+
+// Rows of a streamed list, the table is started by the first row
+struct ListStream {
+  const struct Document *doc; // Document the tasks point into
+  struct Filter *filter;      // Set when the window counts matches only
+  size_t skip;                // Matches still to skip
+  size_t left;                // Matches still to show, 0 for no limit
+  struct Render render;
+  struct Serializer out; // Used instead of render in machine formats
+  uint32_t max_id;
+  bool started;
+};
+
+// Render one task as soon as it is parsed
+bool stream_row(const Todo *todo, void *ctx) {
+  struct ListStream *stream = ctx;
+  if (stream->filter) {
+    // Matches found earlier still go out while the scan passes others
+    if (!filter_match(stream->filter, stream->doc->data, stream->doc->size,
+                      todo->offset, todo->length, todo->is_done)) {
+      serializer_tick(&stream->out);
+      return true;
+    }
+    if (stream->skip > 0) {
+      stream->skip--;
+      serializer_tick(&stream->out);
+      return true;
+    }
+  }
+
+  const char *text = stream->doc->data + todo->offset;
+  if (output != FORMAT_TABLE) {
+    serialize_task(&stream->out, todo->id, text, todo->length,
+                   todo->is_done);
+    if (stream->left > 0 && --stream->left == 0) {
+      return false;
+    }
+    return !stream->out.failed;
+  }
+
+  if (!stream->started) {
+    if (!render_begin_stream(&stream->render, STDOUT_FILENO, stream->max_id)) {
+      render_end(&stream->render);
+      return false;
+    }
+    stream->started = true;
+  }
+
+  render_row(&stream->render, todo->id, text, todo->length, todo->is_done);
+  if (stream->left > 0 && --stream->left == 0) {
+    return false;
+  }
+  return !stream->render.failed;
+}
+
+// Print the tasks passing filter, all of them at once with exact widths
+void print_matches(const struct Document *doc, const char *path,
+                   struct Filter *filter, size_t tail) {
+  struct TodoTable todos;
+  if (!find_todos(doc, filter, &todos)) {
+    return;
+  }
+
+  size_t first = todos.count > tail ? todos.count - tail : 0;
+  if (output != FORMAT_TABLE) {
+    struct Serializer out;
+    if (serializer_begin(&out, STDOUT_FILENO, output)) {
+      for (size_t i = first; i < todos.count; i++) {
+        serialize_task(&out, todos.ids[i], doc->data + todos.offsets[i],
+                       todos.lengths[i], bitmap_get(todos.done, i));
       }
+    }
+    serializer_end(&out);
+  } else if (todos.count == 0) {
+    print_info("No matching task in %s.", path);
+  } else {
+    print_todos(doc, &todos, first);
+  }
+  free_table(&todos);
+}
+
+// Print the tasks with IDs in (skip, skip + limit], or the last tail ones,
+// without parsing further than the last row shown. With an active filter
+// the window counts matching tasks only. Machine formats always come
+// through here so their rows flow out while the file is still parsed.
+void print_window(const char *path, size_t skip, size_t limit, size_t tail,
+                  struct Filter *filter) {
+  struct Document doc;
+  if (!doc_load(&doc, path)) {
+    return;
+  }
+
+  // Filtered NDJSON is streamed too, its reader sees each match early
+  bool filtered = filter_active(filter);
+  if (filtered && (tail > 0 || (skip == 0 && limit == 0 &&
+                                output != FORMAT_NDJSON))) {
+    print_matches(&doc, path, filter, tail ? tail : SIZE_MAX);
+    doc_close(&doc);
+    return;
+  }
+
+  struct ListStream stream = {.doc = &doc};
+  size_t max_id;
+  if (tail > 0) {
+    size_t total;
+    if (!count_todos(path, &total)) {
+      doc_close(&doc);
+      return;
+    }
+    skip = total > tail ? total - tail : 0;
+    limit = tail;
+    max_id = total;
+  } else if (limit > 0 && !filtered) {
+    max_id = skip + limit;
+  } else { // Every task line takes at least six bytes
+    max_id = doc.size / 6 + 1;
+  }
+  stream.max_id = max_id < UINT32_MAX ? max_id : UINT32_MAX;
+
+  if (output != FORMAT_TABLE &&
+      !serializer_begin(&stream.out, STDOUT_FILENO, output)) {
+    serializer_end(&stream.out);
+    doc_close(&doc);
+    return;
+  }
+
+  if (filtered) {
+    stream.filter = filter;
+    stream.skip = skip;
+    stream.left = limit;
+    scan_todos(&doc, stream_row, &stream);
+  } else {
+    window_todos(&doc, path, skip, limit, stream_row, &stream);
+  }
 
-      if (write_todos(todos, path)) {
-        print_info("Updated %s", path);
+  if (output != FORMAT_TABLE) {
+    serializer_end(&stream.out);
+  } else if (stream.started) {
+    render_end(&stream.render);
+  } else if (filtered) {
+    print_info("No matching task in %s.", path);
+  } else {
+    print_info("No task in %s. Yeah!", path);
+  }
+  doc_close(&doc);
+}
+
+// Print the tasks of every file called name under root, keyed by
+// "path:id" so each row can be fed back to done, undone and remove. The
+// window and tail count rows of the merged list.
+void print_workspace(const char *root, const char *name, struct Filter *filter,
+                     bool count, size_t skip, size_t limit, size_t tail,
+                     char **excludes, size_t exclude_count) {
+  struct Workspace ws;
+  size_t span = stats_begin("scan");
+  bool ok = workspace_scan(&ws, root, name, filter, excludes, exclude_count);
+  stats_end(span);
+  if (!ok) {
+    return;
+  }
+
+  if (count) {
+    printf("%zu\n", ws.tasks);
+    workspace_free(&ws);
+    return;
+  }
+
+  size_t first = tail > 0 ? (ws.tasks > tail ? ws.tasks - tail : 0) : skip;
+  size_t end = tail > 0 ? ws.tasks : skip + limit;
+  if ((tail == 0 && limit == 0) || end > ws.tasks) {
+    end = ws.tasks;
+  }
+
+  if (first >= end && output == FORMAT_TABLE) {
+    print_info(filter_active(filter) ? "No matching task under %s."
+                                     : "No task under %s. Yeah!",
+               root);
+    workspace_free(&ws);
+    return;
+  }
+
+  // Column widths come from the rows actually shown
+  size_t max_key = 0, max_width = 0, row = 0;
+  for (size_t f = 0; f < ws.count && row < end; f++) {
+    const struct WorkspaceFile *file = &ws.files[f];
+    size_t path_width = display_width(file->path, strlen(file->path));
+    for (size_t i = 0; i < file->todos.count && row < end; i++, row++) {
+      if (row < first) {
+        continue;
       }
+      size_t key = path_width + 1 + num_digits(file->todos.ids[i]);
+      size_t width = display_width(file->doc.data + file->todos.offsets[i],
+                                   file->todos.lengths[i]);
+      max_key = key > max_key ? key : max_key;
+      max_width = width > max_width ? width : max_width;
+    }
+  }
+
+  span = stats_begin("render");
+  struct Render r;
+  struct Serializer out;
+  bool started = output == FORMAT_TABLE
+                     ? render_begin_keyed(&r, STDOUT_FILENO, max_key,
+                                          max_width)
+                     : serializer_begin(&out, STDOUT_FILENO, output);
+
+  row = 0;
+  for (size_t f = 0; started && f < ws.count && row < end; f++) {
+    const struct WorkspaceFile *file = &ws.files[f];
+    const struct TodoTable *todos = &file->todos;
+    size_t path_len = strlen(file->path);
+    char *key = malloc(path_len + 12); // ":" and up to ten digits
+    if (!key) {
+      print_err("Memory allocation failed");
+      break;
+    }
+    memcpy(key, file->path, path_len);
 
-      free_list(todos);
-      free(ids);
+    for (size_t i = 0; i < todos->count && row < end; i++, row++) {
+      if (row < first) {
+        continue;
+      }
+      const char *text = file->doc.data + todos->offsets[i];
+      bool is_done = bitmap_get(todos->done, i);
+      if (output != FORMAT_TABLE) {
+        serialize_task_in(&out, file->path, todos->ids[i], text,
+                          todos->lengths[i], is_done);
+        continue;
+      }
+      int n = snprintf(key + path_len, 12, ":%u", todos->ids[i]);
+      render_row_keyed(&r, key, path_len + n, text, todos->lengths[i],
+                       is_done);
     }
+    free(key);
+  }
+
+  if (output == FORMAT_TABLE) {
+    render_end(&r);
+  } else {
+    serializer_end(&out);
   }
+  stats_end(span);
+  workspace_free(&ws);
 }
 
-int get_num_digits(int num) { return snprintf(NULL, 0, "%d", num); }
+// Print the tasks passing filter ordered by spec, the window and tail
+// count rows of the sorted list
+void print_sorted(const char *path, struct Filter *filter,
+                  const struct SortSpec *spec, size_t skip, size_t limit,
+                  size_t tail) {
+  struct Document doc;
+  if (!doc_load(&doc, path)) {
+    return;
+  }
+
+  struct TodoTable todos;
+  bool ok = filter_active(filter) ? find_todos(&doc, filter, &todos)
+                                  : load_todos(&doc, path, &todos);
+  if (!ok) {
+    doc_close(&doc);
+    return;
+  }
+
+  size_t span = stats_begin("sort");
+  struct TaskMeta meta = {0};
+  uint32_t *order = malloc((todos.count + 1) * sizeof(*order));
+  if (!order) {
+    print_err("Memory allocation failed");
+  }
+  ok = order && meta_extract(&doc, &todos, &meta) &&
+       meta_sort(&todos, &meta, spec, order);
+  meta_free(&meta);
+  stats_end(span);
+
+  size_t first = tail > 0 ? (todos.count > tail ? todos.count - tail : 0)
+                          : skip;
+  size_t end = tail > 0 ? todos.count : skip + limit;
+  if ((tail == 0 && limit == 0) || end > todos.count) {
+    end = todos.count;
+  }
 
-int max(int n, int m) {
-  if (n < m) {
-    return m;
+  // Rows are copied in sorted order, they keep their IDs
+  struct TodoTable sorted = {0};
+  for (size_t k = first; ok && k < end; k++) {
+    Todo todo = table_get(&todos, order[k]);
+    ok = table_push(&sorted, &todo);
+  }
+
+  if (!ok) {
+    // Reported where it failed
+  } else if (output != FORMAT_TABLE) {
+    struct Serializer out;
+    if (serializer_begin(&out, STDOUT_FILENO, output)) {
+      for (size_t i = 0; i < sorted.count; i++) {
+        serialize_task(&out, sorted.ids[i], doc.data + sorted.offsets[i],
+                       sorted.lengths[i], bitmap_get(sorted.done, i));
+      }
+    }
+    serializer_end(&out);
+  } else if (sorted.count == 0) {
+    print_info(filter_active(filter) ? "No matching task in %s."
+                                     : "No task in %s. Yeah!",
+               path);
+  } else {
+    print_todos(&doc, &sorted, 0);
   }
-  return n;
+
+  free_table(&sorted);
+  free_table(&todos);
+  free(order);
+  doc_close(&doc);
 }
 
-void print_line(char *c1, char *c2, char *c3, int c1_w, int c2_w, int c3_w) {
-  printf("%s", c1); // Left corner
-  for (int i = 0; i < c1_w; i++)
-    printf("%s", H_LINE);
-  printf("%s", c2);
-  for (int i = 0; i < c2_w; i++)
-    printf("%s", H_LINE);
-  printf("%s", c2);
-  for (int i = 0; i < c3_w; i++)
-    printf("%s", H_LINE);
-  printf("%s\n", c3); // Right corner
+// Print one line of counts, sections indented under their file
+void print_counts(const char *name, size_t len, const struct Tally *tally,
+                  bool section) {
+  printf("%s%.*s: %zu tasks, %zu open, %zu done (%.1f%%)\n",
+         section ? "  " : "", (int)len, name, tally->total,
+         tally->total - tally->done, tally->done,
+         tally->total ? 100.0 * tally->done / tally->total : 0.0);
 }
 
-void print_data(int c1, char *c2, bool c3, int c1_w, int c2_w, int c3_w) {
-  printf(V_LINE);
-  printf(" %d%*s", c1, c1_w - get_num_digits(c1) - 1, "");
-  printf(V_LINE);
-  printf(" %s%*s", c2, c2_w - (int)strlen(c2) - 1, "");
-  printf(V_LINE);
-  printf(" %s%*s",
-         c3 ? COLOR_GREEN CHECK_MARK STYLE_RESET
-            : COLOR_RED CROSS_MARK STYLE_RESET,
-         c3_w - 2, "");
-  printf(V_LINE);
-  printf("\n");
+// Where the sections of one file are printed
+struct StatsOutput {
+  const char *path;
+  struct Serializer *out; // Set in machine formats
+};
+
+// Print the counts of one heading section
+bool print_section(const char *title, size_t len, const struct Tally *tally,
+                   void *ctx) {
+  struct StatsOutput *stats = ctx;
+  if (stats->out) {
+    serialize_counts(stats->out, stats->path, title, len, tally->total,
+                     tally->done);
+    return !stats->out->failed;
+  }
+  if (len == 0) {
+    title = "(no heading)";
+    len = strlen(title);
+  }
+  print_counts(title, len, tally, true);
+  return true;
 }
 
-void print_todos(struct TodoNode *head) {
-  int c1_w = 3; // #
-  int c2_w = 6; // Task
-  int c3_w = 6; // Done
+// Print the counts of one file, then of its sections if asked
+void print_file_stats(const char *path, const struct Document *doc,
+                      const struct Tally *tally, bool sections,
+                      struct Serializer *out) {
+  if (out) {
+    serialize_counts(out, path, NULL, 0, tally->total, tally->done);
+  } else {
+    print_counts(path, strlen(path), tally, false);
+  }
 
-  struct TodoNode *elt, *tmp;
-  DL_FOREACH_SAFE(head, elt, tmp) {
-    c1_w = max(get_num_digits(elt->todo.id) + 2, c1_w);
-    c2_w = max(c2_w, strlen(elt->todo.content) + 2);
+  if (sections) {
+    struct StatsOutput stats = {.path = path, .out = out};
+    struct Tally again;
+    tally_doc(doc, &again, print_section, &stats);
   }
+}
 
-  // Print the top border
-  print_line(TOP_LEFT, TOP_MID, TOP_RIGHT, c1_w, c2_w, c3_w);
+// Print how many tasks of file_path are open and done. Without sections
+// this is one pass over the file, or over its index when it is current.
+void print_stats(const char *path, bool sections) {
+  struct Tally tally;
+  struct Document doc = {0};
+  if (!tally_file(path, &tally) || (sections && !doc_load(&doc, path))) {
+    return;
+  }
 
-  // Print heading
-  printf("%s %s", V_LINE, STYLE_BOLD "#" STYLE_RESET);
-  printf("%*s", c1_w - 2, "");
-  printf(V_LINE);
-  printf(" %s%*s", STYLE_BOLD "Task" STYLE_RESET, c2_w - 5, "");
-  printf(V_LINE);
-  printf(" %s%*s", STYLE_BOLD "Done" STYLE_RESET, c3_w - 5, "");
-  printf(V_LINE);
-  printf("\n");
+  struct Serializer out;
+  bool machine = output != FORMAT_TABLE;
+  if (!machine || serializer_begin(&out, STDOUT_FILENO, output)) {
+    print_file_stats(path, &doc, &tally, sections, machine ? &out : NULL);
+  }
+  if (machine) {
+    serializer_end(&out);
+  }
+  doc_close(&doc);
+}
 
-  // Print middle separator
-  print_line(LEFT_MID, CROSS, RIGHT_MID, c1_w, c2_w, c3_w);
+// Print the counts of every file called name under root and their sum
+void print_workspace_stats(const char *root, const char *name, bool sections,
+                           char **excludes, size_t exclude_count) {
+  struct Workspace ws;
+  struct Filter everything = {0};
+  if (!workspace_scan(&ws, root, name, &everything, excludes,
+                      exclude_count)) {
+    return;
+  }
 
-  // Print table data
-  DL_FOREACH_SAFE(head, elt, tmp) {
-    print_data(elt->todo.id, elt->todo.content, elt->todo.is_done, c1_w, c2_w,
-               c3_w);
+  struct Serializer out;
+  bool machine = output != FORMAT_TABLE;
+  struct Tally sum = {0};
+  if (!machine || serializer_begin(&out, STDOUT_FILENO, output)) {
+    for (size_t f = 0; f < ws.count; f++) {
+      const struct TodoTable *todos = &ws.files[f].todos;
+      struct Tally tally = {.total = todos->count};
+      for (size_t w = 0; w < BITMAP_WORDS(todos->count); w++) {
+        uint64_t bits = todos->done[w];
+        if (w == todos->count / 64) { // Bits past the last task are unused
+          bits &= ((uint64_t)1 << (todos->count % 64)) - 1;
+        }
+        tally.done += __builtin_popcountll(bits);
+      }
+      sum.total += tally.total;
+      sum.done += tally.done;
+      print_file_stats(ws.files[f].path, &ws.files[f].doc, &tally, sections,
+                       machine ? &out : NULL);
+    }
   }
 
-  // Print bottom border
-  print_line(BOTTOM_LEFT, BOTTOM_MID, BOTTOM_RIGHT, c1_w, c2_w, c3_w);
+  if (machine) {
+    serializer_end(&out);
+  } else {
+    char name[64];
+    int len = snprintf(name, sizeof(name), "Total of %zu files", ws.count);
+    print_counts(name, len, &sum, false);
+  }
+  workspace_free(&ws);
 }
 
 int main(int argc, char **argv) {
@@ -274,13 +857,28 @@ int main(int argc, char **argv) {
   }
 
   // Parse arguments
-  arg *arguments = NULL;
+  arg *arguments = malloc(argc * sizeof(arg));
+  int arg_count = 0;
 
   bool help = false;
   bool version = false;
   char *file_path = "TODO.md";
+  enum Durability durability = DURABILITY_NONE;
   bool list = false;
+  bool count = false;
+  bool use_index = false;
   bool clear = false;
+  bool serve = false;
+  bool watch = false;
+  bool show_stats = false; // stats command, --stats is instrumentation
+  bool sections = false;
+  bool stats = false;
+  size_t limit = 0, offset = 0, tail = 0;
+  struct Filter filter = {0};
+  struct SortSpec sort = {0};
+  char *recursive = NULL; // Workspace root
+  char *excludes[argc];    // --exclude patterns
+  size_t exclude_count = 0;
 
   for (int i = 1; i < argc; i++) {
     if (strcmp(argv[i], "--help") == 0 || strcmp(argv[i], "-h") == 0) {
@@ -291,61 +889,244 @@ int main(int argc, char **argv) {
     } else if (strcmp(argv[i], "--file") == 0 || strcmp(argv[i], "-f") == 0) {
       i++; // Move to next arg
       file_path = argv[i];
+    } else if ((strcmp(argv[i], "--sync") == 0 || strcmp(argv[i], "-s") == 0) &&
+               i < argc - 1) {
+      i++; // Move to next arg
+      if (!parse_durability(argv[i], &durability)) {
+        print_err("Invalid sync mode. See '--help' for details.");
+        free(arguments);
+        return EXIT_FAILURE;
+      }
     } else if (strcmp(argv[i], "init") == 0 && i < argc - 1) {
       i++; // Move to next arg
-      add_argument(&arguments, argv[i - 1], argv[i]);
+      add_argument(arguments, &arg_count, argv[i - 1], argv[i]);
     } else if (strcmp(argv[i], "add") == 0 && i < argc - 1) {
       i++; // Move to next arg
-      add_argument(&arguments, argv[i - 1], argv[i]);
+      add_argument(arguments, &arg_count, argv[i - 1], argv[i]);
     } else if (strcmp(argv[i], "list") == 0) {
       list = true;
+    } else if ((strcmp(argv[i], "--recursive") == 0 ||
+                strcmp(argv[i], "-r") == 0) &&
+               i < argc - 1) {
+      i++; // Move to next arg
+      recursive = argv[i];
+    } else if (strcmp(argv[i], "--exclude") == 0 && i < argc - 1) {
+      i++; // Move to next arg
+      excludes[exclude_count++] = argv[i];
+    } else if (strcmp(argv[i], "stats") == 0) {
+      show_stats = true;
+    } else if (strcmp(argv[i], "--sections") == 0) {
+      sections = true;
+    } else if (strcmp(argv[i], "--count") == 0) {
+      count = true;
+    } else if ((strcmp(argv[i], "--limit") == 0 ||
+                strcmp(argv[i], "--offset") == 0 ||
+                strcmp(argv[i], "--tail") == 0) &&
+               i < argc - 1) {
+      i++; // Move to next arg
+      size_t *target = strcmp(argv[i - 1], "--limit") == 0    ? &limit
+                       : strcmp(argv[i - 1], "--offset") == 0 ? &offset
+                                                              : &tail;
+      if (!parse_count(argv[i], target)) {
+        print_err("Invalid count. See '--help' for details.");
+        filter_free(&filter);
+        free(arguments);
+        return EXIT_FAILURE;
+      }
+    } else if (strcmp(argv[i], "--format") == 0 && i < argc - 1) {
+      i++; // Move to next arg
+      if (!parse_format(argv[i], &output)) {
+        print_err("Invalid format. See '--help' for details.");
+        free(arguments);
+        return EXIT_FAILURE;
+      }
+    } else if (strcmp(argv[i], "--grep") == 0 && i < argc - 1) {
+      i++; // Move to next arg
+      filter_text(&filter, argv[i]);
+    } else if (strcmp(argv[i], "--regex") == 0 && i < argc - 1) {
+      i++; // Move to next arg
+      if (!filter_regex(&filter, argv[i])) {
+        filter_free(&filter);
+        free(arguments);
+        return EXIT_FAILURE;
+      }
+    } else if (strcmp(argv[i], "--tag") == 0 && i < argc - 1) {
+      i++; // Move to next arg
+      filter_tag(&filter, argv[i]);
+    } else if (strcmp(argv[i], "--sort") == 0 && i < argc - 1) {
+      i++; // Move to next arg
+      if (!parse_sort(argv[i], &sort)) {
+        filter_free(&filter);
+        free(arguments);
+        return EXIT_FAILURE;
+      }
+    } else if (strcmp(argv[i], "--status") == 0 && i < argc - 1) {
+      i++; // Move to next arg
+      if (!filter_status(&filter, argv[i])) {
+        filter_free(&filter);
+        free(arguments);
+        return EXIT_FAILURE;
+      }
+    } else if ((strcmp(argv[i], "--threads") == 0 ||
+                strcmp(argv[i], "-t") == 0) &&
+               i < argc - 1) {
+      i++; // Move to next arg
+      set_parse_threads(strtoul(argv[i], NULL, 10));
+    } else if (strcmp(argv[i], "--index") == 0 || strcmp(argv[i], "-i") == 0) {
+      use_index = true;
+    } else if (strcmp(argv[i], "--journal") == 0 ||
+               strcmp(argv[i], "-j") == 0) {
+      journal = true;
+      set_journal_mode(true);
+    } else if (strcmp(argv[i], "--stats") == 0) {
+      stats = true;
     } else if (strcmp(argv[i], "done") == 0 && i < argc - 1) {
       i++; // Move to next arg
-      add_argument(&arguments, argv[i - 1], argv[i]);
+      add_argument(arguments, &arg_count, argv[i - 1], argv[i]);
+    } else if (strcmp(argv[i], "undone") == 0 && i < argc - 1) {
+      i++; // Move to next arg
+      add_argument(arguments, &arg_count, argv[i - 1], argv[i]);
     } else if (strcmp(argv[i], "remove") == 0 && i < argc - 1) {
       i++; // Move to next arg
-      add_argument(&arguments, argv[i - 1], argv[i]);
+      add_argument(arguments, &arg_count, argv[i - 1], argv[i]);
     } else if (strcmp(argv[i], "clear") == 0) {
       clear = true;
+    } else if (strcmp(argv[i], "compact") == 0) {
+      add_argument(arguments, &arg_count, argv[i], NULL);
+    } else if (strcmp(argv[i], "serve") == 0) {
+      serve = true;
+    } else if (strcmp(argv[i], "watch") == 0) {
+      watch = true;
+    } else if (strcmp(argv[i], "batch") == 0) {
+      char *script = "-"; // Read operations from stdin by default
+      if (i < argc - 1 &&
+          (argv[i + 1][0] != '-' || strcmp(argv[i + 1], "-") == 0)) {
+        i++; // Move to next arg
+        script = argv[i];
+      }
+      add_argument(arguments, &arg_count, "batch", script);
     } else {
       print_err("Invalid arguments. See '--help' for details.");
-      hash_release(&arguments);
+      free(arguments);
       return EXIT_FAILURE;
     }
   }
 
-  exec(&arguments, file_path);
+  if (serve) {
+    free(arguments);
+    return daemon_serve() ? EXIT_SUCCESS : EXIT_FAILURE;
+  }
 
-  if (list) {
-    struct TodoNode *head = list_todos(file_path);
-    if (!head && !errno) {
-      print_info("No task in %s. Yeah!", file_path);
-    }
+  stats_init(stats, getenv("TD_TRACE"));
 
-    if (head) {
-      print_todos(head);
-      free_list(head);
-    }
+  if (watch) {
+    bool ok = watch_file(file_path);
+    stats_finish(argc, argv);
+    free(arguments);
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+  }
+
+  int daemon = DAEMON_UNKNOWN;
+  exec(arguments, arg_count, file_path, durability, &daemon);
+
+  if (use_index) {
+    refresh_index(file_path);
   }
 
-  if (clear) {
-    if (write_todos(NULL, file_path)) {
-      print_info("Updated %s", file_path);
+  finish_results(); // Before any list output
+
+  struct Document doc;
+  struct DaemonReply reply;
+
+  size_t span = list ? stats_begin("list") : STATS_OFF;
+  size_t total;
+  if (list && recursive) {
+    const char *slash = strrchr(file_path, '/');
+    print_workspace(recursive, slash ? slash + 1 : file_path, &filter, count,
+                    offset, limit, tail, excludes, exclude_count);
+  } else if (list && sort.count > 0 && !count) {
+    print_sorted(file_path, &filter, &sort, offset, limit, tail);
+  } else if (list && count && filter_active(&filter)) {
+    struct TodoTable todos;
+    if (doc_load(&doc, file_path)) {
+      if (find_todos(&doc, &filter, &todos)) {
+        printf("%zu\n", todos.count);
+        free_table(&todos);
+      }
+      doc_close(&doc);
+    }
+  } else if (list && count) {
+    if (count_todos(file_path, &total)) {
+      printf("%zu\n", total);
+    }
+  } else if (list && (limit || offset || tail || filter_active(&filter) ||
+                      output != FORMAT_TABLE)) {
+    print_window(file_path, offset, limit, tail, &filter);
+  } else if (list && call_daemon(&daemon, "list", file_path, "", durability,
+                                 &reply)) {
+    struct TodoTable todos;
+    if (!reply.ok) {
+      print_err(reply.data);
+    } else if (daemon_tasks(&reply, &doc, &todos)) {
+      if (todos.count == 0) {
+        print_info("No task in %s. Yeah!", file_path);
+      } else {
+        print_todos(&doc, &todos, 0);
+      }
+      free_table(&todos);
+    }
+    daemon_reply_free(&reply);
+  } else if (list && doc_load(&doc, file_path)) {
+    struct TodoTable todos;
+    if (load_todos(&doc, file_path, &todos)) {
+      if (todos.count == 0) {
+        print_info("No task in %s. Yeah!", file_path);
+      } else {
+        print_todos(&doc, &todos, 0);
+      }
+      free_table(&todos);
     }
+    doc_close(&doc);
+  }
+  stats_end(span);
+
+  span = show_stats ? stats_begin("stats") : STATS_OFF;
+  if (show_stats && recursive) {
+    const char *slash = strrchr(file_path, '/');
+    print_workspace_stats(recursive, slash ? slash + 1 : file_path, sections,
+                          excludes, exclude_count);
+  } else if (show_stats) {
+    print_stats(file_path, sections);
+  }
+  stats_end(span);
+
+  span = clear ? stats_begin("clear") : STATS_OFF;
+  if (clear && doc_open(&doc, file_path)) {
+    bool ok = write_todos(&doc, NULL, file_path, durability);
+    report("clear", NULL, file_path, ok, "Updated %s", file_path);
+    doc_close(&doc);
+    finish_results();
+  }
+  stats_end(span);
+  stats_finish(argc, argv);
+
+  if (daemon >= 0) {
+    close(daemon);
   }
+  filter_free(&filter);
 
   if (help) {
     print_help(argv[0]);
-    hash_release(&arguments);
+    free(arguments);
     return EXIT_SUCCESS;
   }
 
   if (version) {
     printf("%s version %s\n", argv[0], PROJECT_VERSION);
-    hash_release(&arguments);
+    free(arguments);
     return EXIT_SUCCESS;
   }
 
-  hash_release(&arguments);
+  free(arguments);
   return EXIT_SUCCESS;
 }
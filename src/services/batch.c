@@ -0,0 +1,461 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2025 Võ Quang Chiến
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "batch.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "../utils/bitmap.h"
+#include "../utils/fmt.h"
+#include "../utils/stats.h"
+#include "index.h"
+#include "journal.h"
+#include "lock.h"
+#include "pieces.h"
+
+// Load file_path for editing
+bool batch_open(struct Batch *b, const char *file_path) {
+  *b = (struct Batch){.fd = -1};
+
+  b->path = strdup(file_path);
+  b->fd = open(file_path, O_RDONLY);
+  if (!b->path || b->fd < 0) {
+    print_err(b->path ? strerror(errno) : "Memory allocation failed");
+    batch_close(b);
+    return false;
+  }
+  stats_add(STAT_OPENS, 1);
+
+  if (!doc_map(&b->doc, b->fd)) {
+    batch_close(b);
+    return false;
+  }
+
+  if (!load_todos(&b->doc, file_path, &b->base)) {
+    batch_close(b);
+    return false;
+  }
+
+  size_t n = b->base.count;
+  b->removed = calloc(BITMAP_WORDS(n) + 1, sizeof(uint64_t));
+  b->live_capacity = n + 16;
+  b->live = malloc(b->live_capacity * sizeof(*b->live));
+  if (!b->removed || !b->live) {
+    print_err("Memory allocation failed");
+    batch_close(b);
+    return false;
+  }
+
+  for (size_t i = 0; i < n; i++) {
+    b->live[i] = i;
+  }
+  b->live_count = n;
+
+  // Pending journal records are part of the document
+  if (!journal_replay(b)) {
+    batch_close(b);
+    return false;
+  }
+  b->changes = 0;
+  return true;
+}
+
+// Number of tasks the document has right now
+size_t batch_count(const struct Batch *b) { return b->live_count; }
+
+// Append a task
+bool batch_add(struct Batch *b, const char *task, bool is_done) {
+  if (b->added_count == b->added_capacity) {
+    size_t capacity = b->added_capacity ? b->added_capacity * 2 : 16;
+    struct BatchTask *added = realloc(b->added, capacity * sizeof(*added));
+    if (!added) {
+      print_err("Memory allocation failed");
+      return false;
+    }
+    b->added = added;
+    b->added_capacity = capacity;
+  }
+
+  if (b->live_count == b->live_capacity) {
+    size_t capacity = b->live_capacity * 2;
+    size_t *live = realloc(b->live, capacity * sizeof(*live));
+    if (!live) {
+      print_err("Memory allocation failed");
+      return false;
+    }
+    b->live = live;
+    b->live_capacity = capacity;
+  }
+
+  size_t length = strlen(task);
+  char *text = arena_alloc(&b->text, length + 1);
+  if (!text) {
+    print_err("Memory allocation failed");
+    return false;
+  }
+  memcpy(text, task, length + 1);
+
+  b->added[b->added_count] = (struct BatchTask){
+      .text = text, .length = length, .is_done = is_done};
+  b->live[b->live_count++] = b->base.count + b->added_count++;
+  b->changes++;
+  return true;
+}
+
+// Task with ID id as the document has it right now, false if there is none
+bool batch_get(const struct Batch *b, size_t id, struct BatchTask *out) {
+  if (id == 0 || id > b->live_count) {
+    return false;
+  }
+
+  size_t slot = b->live[id - 1];
+  if (slot >= b->base.count) {
+    *out = b->added[slot - b->base.count];
+    return true;
+  }
+
+  *out = (struct BatchTask){
+      .text = b->doc.data + b->base.offsets[slot],
+      .length = b->base.lengths[slot],
+      .is_done = bitmap_get(b->base.done, slot),
+  };
+  return true;
+}
+
+// True if the task in slot is completed
+bool _slot_done(const struct Batch *b, size_t slot) {
+  return slot < b->base.count ? bitmap_get(b->base.done, slot)
+                              : b->added[slot - b->base.count].is_done;
+}
+
+// Bitmap over the current IDs of the tasks sel matches
+uint64_t *_batch_select(const struct Batch *b, const struct Selector *sel) {
+  size_t n = b->live_count;
+  uint64_t *bits = calloc(BITMAP_WORDS(n) + 1, sizeof(uint64_t));
+  uint64_t *done = NULL;
+  if (bits && selector_needs_status(sel)) {
+    done = calloc(BITMAP_WORDS(n) + 1, sizeof(uint64_t));
+    for (size_t i = 0; done && i < n; i++) {
+      if (_slot_done(b, b->live[i])) {
+        bitmap_set(done, i);
+      }
+    }
+    if (!done) {
+      free(bits);
+      bits = NULL;
+    }
+  }
+
+  if (!bits) {
+    print_err("Memory allocation failed");
+    return NULL;
+  }
+
+  selector_match(sel, n, done, bits);
+  free(done);
+  return bits;
+}
+
+// Set the status of the tasks sel matches
+bool batch_set_status(struct Batch *b, const struct Selector *sel,
+                      bool is_done) {
+  uint64_t *selected = _batch_select(b, sel);
+  if (!selected) {
+    return false;
+  }
+
+  size_t n = b->live_count;
+  for (size_t i = bitmap_next(selected, 0, n); i < n;
+       i = bitmap_next(selected, i + 1, n)) {
+    size_t slot = b->live[i];
+    if (slot < b->base.count) {
+      bitmap_put(b->base.done, slot, is_done);
+    } else {
+      b->added[slot - b->base.count].is_done = is_done;
+    }
+    b->changes++;
+  }
+
+  free(selected);
+  return true;
+}
+
+// Remove the tasks sel matches, later tasks move up
+bool batch_remove(struct Batch *b, const struct Selector *sel) {
+  // All IDs refer to the numbering before this operation
+  uint64_t *selected = _batch_select(b, sel);
+  if (!selected) {
+    return false;
+  }
+
+  // One pass drops the tasks and renumbers every task after them
+  size_t kept = 0;
+  for (size_t i = 0; i < b->live_count; i++) {
+    size_t slot = b->live[i];
+    if (!bitmap_get(selected, i)) {
+      b->live[kept++] = slot;
+    } else if (slot < b->base.count) {
+      bitmap_set(b->removed, slot);
+    } else {
+      b->added[slot - b->base.count].removed = true;
+    }
+  }
+
+  if (kept != b->live_count) {
+    b->live_count = kept;
+    b->changes++;
+  }
+
+  free(selected);
+  return true;
+}
+
+// Remove every task
+void batch_clear(struct Batch *b) {
+  for (size_t i = 0; i < b->live_count; i++) {
+    size_t slot = b->live[i];
+    if (slot < b->base.count) {
+      bitmap_set(b->removed, slot);
+    } else {
+      b->added[slot - b->base.count].removed = true;
+    }
+  }
+  b->live_count = 0;
+  b->changes++;
+}
+
+// Stream the document as the batch has it into w. With entries, also fill
+// them with the index of the new document from old, the base index.
+bool _batch_emit(const struct Batch *b, struct Writer *w,
+                 const struct IndexEntry *old, struct IndexEntry *entries,
+                 size_t *kept) {
+  const struct Document *doc = &b->doc;
+  const struct TodoTable *base = &b->base;
+
+  // Only removed lines and flipped checkboxes become edits, everything
+  // else in the file is written back byte for byte
+  struct PieceTable pt;
+  pieces_init(&pt, doc, b->fd);
+  size_t removed = 0;
+  bool ok = true;
+
+  for (size_t i = 0; ok && i < base->count; i++) {
+    size_t line = base->lines[i];
+    size_t end = base->offsets[i] + base->lengths[i];
+    size_t next = end < doc->size ? end + 1 : end;
+
+    if (bitmap_get(b->removed, i)) {
+      ok = pieces_replace(&pt, line, next - line, NULL, 0);
+      removed += next - line;
+      continue;
+    }
+
+    bool is_done = bitmap_get(base->done, i);
+    size_t mark = mark_offset(doc->data, line);
+    if (is_done != (doc->data[mark] != ' ')) {
+      ok = pieces_replace(&pt, mark, 1, is_done ? "x" : " ", 1);
+    }
+
+    if (old && entries) {
+      struct IndexEntry e = old[i];
+      e.line -= removed;
+      e.flags = is_done ? INDEX_DONE : 0;
+      entries[(*kept)++] = e;
+    }
+  }
+
+  for (size_t i = 0; ok && i < b->added_count; i++) {
+    const struct BatchTask *task = &b->added[i];
+    if (task->removed) {
+      continue;
+    }
+    if (pieces_last(&pt) != '\n') {
+      ok = pieces_replace(&pt, doc->size, 0, "\n", 1);
+    }
+
+    if (old && entries) {
+      size_t spaces = strspn(task->text, " ");
+      entries[(*kept)++] = (struct IndexEntry){
+          .line = pieces_size(&pt),
+          .length = 6 + task->length,
+          .content = 6 + spaces,
+          .mark = 3,
+          .flags = task->is_done ? INDEX_DONE : 0,
+      };
+    }
+    ok = ok &&
+         pieces_replace(&pt, doc->size, 0,
+                        task->is_done ? "- [x] " : "- [ ] ", 6) &&
+         pieces_replace(&pt, doc->size, 0, task->text, task->length) &&
+         pieces_replace(&pt, doc->size, 0, "\n", 1);
+  }
+
+  ok = ok && pieces_write(&pt, w);
+  pieces_free(&pt);
+  return ok;
+}
+
+// Write the new file and its index, the body of batch_commit
+bool _batch_commit(struct Batch *b, enum Durability durability) {
+  // Entries of surviving tasks are shifted while the file is written, so
+  // an existing index never has to be rebuilt from a parse
+  struct IndexEntry *old = NULL, *entries = NULL;
+  if (index_exists(b->path)) {
+    old = index_entries(&b->doc, &b->base);
+    entries =
+        malloc((b->base.count + b->added_count + 1) * sizeof(*entries));
+  }
+
+  struct Writer w;
+  if (!writer_open(&w, b->path, durability)) {
+    free(old);
+    free(entries);
+    return false;
+  }
+
+  size_t kept = 0;
+  bool ok = _batch_emit(b, &w, old, entries, &kept);
+
+  // Journal records appended since batch_open would be lost by the commit
+  bool conflict = ok && (!file_unchanged(b->fd, b->path, &b->doc.st) ||
+                         journal_size(b->path) != b->journal_size);
+  if (conflict) {
+    print_err("File changed while updating, try again");
+    ok = false;
+  }
+
+  if (ok) {
+    ok = writer_commit(&w);
+  } else if (w.path) {
+    writer_abort(&w);
+  }
+
+  // The journal is folded into the new file now
+  if (ok && b->journal_size > 0) {
+    journal_remove(b->path);
+  }
+
+  if (ok && old && entries) {
+    index_write(b->path, &w.st, entries, kept);
+  } else if (ok && index_exists(b->path)) {
+    build_index(b->path);
+  }
+
+  free(old);
+  free(entries);
+  if (ok) {
+    b->changes = 0;
+    b->journal_size = 0;
+  }
+  if (conflict) {
+    errno = EAGAIN; // Lets callers tell a lost race from an I/O error
+  }
+  return ok;
+}
+
+// Write every change back to the file at once
+bool batch_commit(struct Batch *b, enum Durability durability) {
+  if (b->changes == 0 && b->journal_size == 0) {
+    return true;
+  }
+
+  // Under the lock the identity check cannot race another td writer, a
+  // conflict means the file really changed since batch_open
+  struct Lock lock;
+  if (!lock_acquire(&lock, b->path)) {
+    return false;
+  }
+  bool ok = _batch_commit(b, durability);
+  int err = errno;
+  lock_release(&lock);
+  errno = err;
+  return ok;
+}
+
+// Apply one operation in the batch script language: add, done, undone and
+// remove with their argument, clear without one
+bool batch_apply(struct Batch *b, const char *op, const char *value) {
+  if (strcmp(op, "add") == 0 || strcmp(op, "add-done") == 0) {
+    return batch_add(b, value, op[3] != '\0');
+  }
+  if (strcmp(op, "clear") == 0) {
+    batch_clear(b);
+    return true;
+  }
+  if (strcmp(op, "done") != 0 && strcmp(op, "undone") != 0 &&
+      strcmp(op, "remove") != 0) {
+    return false;
+  }
+
+  struct Selector sel;
+  if (!selector_parse(&sel, value)) {
+    return false;
+  }
+  bool ok = strcmp(op, "remove") == 0
+                ? batch_remove(b, &sel)
+                : batch_set_status(b, &sel, strcmp(op, "done") == 0);
+  selector_free(&sel);
+  return ok;
+}
+
+// Map the document as the batch has it right now into doc, without
+// touching the file
+bool batch_snapshot(const struct Batch *b, struct Document *doc) {
+  struct Writer w;
+  if (!writer_open_memory(&w)) {
+    return false;
+  }
+  if (!_batch_emit(b, &w, NULL, NULL, NULL)) {
+    writer_abort(&w);
+    return false;
+  }
+
+  int fd = writer_finish(&w);
+  if (fd < 0) {
+    return false;
+  }
+  bool ok = doc_map(doc, fd);
+  close(fd);
+  return ok;
+}
+
+// Release the batch, uncommitted changes are dropped
+void batch_close(struct Batch *b) {
+  free_table(&b->base);
+  doc_close(&b->doc);
+  if (b->fd >= 0) {
+    close(b->fd);
+  }
+  arena_free(&b->text);
+  free(b->removed);
+  free(b->added);
+  free(b->live);
+  free(b->path);
+  *b = (struct Batch){.fd = -1};
+}
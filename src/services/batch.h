@@ -0,0 +1,102 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2025 Võ Quang Chiến
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef BATCH_H
+#define BATCH_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "../utils/arena.h"
+#include "selector.h"
+#include "storage.h"
+#include "writer.h"
+
+// A task added during the batch
+struct BatchTask {
+  const char *text;
+  size_t length;
+  bool is_done;
+  bool removed;
+};
+
+// A document loaded once, edited in memory by many operations and written
+// back with a single commit
+struct Batch {
+  char *path;
+  int fd;
+  struct Document doc;
+  struct TodoTable base;   // Tasks of the file as loaded
+  uint64_t *removed;       // Base tasks dropped by the batch
+  struct BatchTask *added; // Tasks added by the batch
+  size_t added_count;
+  size_t added_capacity;
+  size_t *live; // Slot of the task with ID n at n - 1, added tasks come
+                // after the base tasks
+  size_t live_count;
+  size_t live_capacity;
+  struct Arena text; // Text of added tasks
+  size_t changes;
+  size_t journal_size; // Size of the journal replayed by batch_open, the
+                       // commit folds it into the file
+};
+
+// Load file_path for editing
+bool batch_open(struct Batch *b, const char *file_path);
+
+// Number of tasks the document has right now
+size_t batch_count(const struct Batch *b);
+
+// Task with ID id as the document has it right now, false if there is none
+bool batch_get(const struct Batch *b, size_t id, struct BatchTask *out);
+
+// Append a task
+bool batch_add(struct Batch *b, const char *task, bool is_done);
+
+// Set the status of the tasks sel matches
+bool batch_set_status(struct Batch *b, const struct Selector *sel,
+                      bool is_done);
+
+// Remove the tasks sel matches, later tasks move up
+bool batch_remove(struct Batch *b, const struct Selector *sel);
+
+// Remove every task
+void batch_clear(struct Batch *b);
+
+// Apply one operation in the batch script language: add, done, undone and
+// remove with their argument, clear without one
+bool batch_apply(struct Batch *b, const char *op, const char *value);
+
+// Map the document as the batch has it right now into doc, without
+// touching the file
+bool batch_snapshot(const struct Batch *b, struct Document *doc);
+
+// Write every change back to the file at once
+bool batch_commit(struct Batch *b, enum Durability durability);
+
+// Release the batch, uncommitted changes are dropped
+void batch_close(struct Batch *b);
+
+#endif
@@ -0,0 +1,592 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2025 Võ Quang Chiến
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "daemon.h"
+
+#include <errno.h>
+#include <limits.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "../utils/bitmap.h"
+#include "../utils/fmt.h"
+#include "journal.h"
+#include "selector.h"
+
+// Constants
+#define DAEMON_MAX_CLIENTS 64
+#define DAEMON_MAX_DOCS 64
+#define DAEMON_MAX_FRAME (64 * 1024 * 1024)
+#define DAEMON_WATCH_MASK                                                      \
+  (IN_CLOSE_WRITE | IN_MODIFY | IN_MOVED_TO | IN_MOVED_FROM | IN_DELETE |      \
+   IN_CREATE | IN_ATTRIB)
+
+// Growable byte buffer used to build frames
+struct _Frame {
+  char *data;
+  size_t len;
+  size_t cap;
+};
+
+// A document kept parsed between requests
+struct _Cached {
+  char *path;       // Absolute path
+  const char *base; // File name inside path, matched against inotify events
+  int wd;           // Watch on the parent directory
+  bool stale;
+  struct Document doc;
+  struct TodoTable table;
+  struct _Frame list; // Ready-made reply to a list request
+};
+
+static struct _Cached *cache[DAEMON_MAX_DOCS];
+static size_t cache_count;
+static int inotify_fd = -1;
+
+// Append bytes to a frame
+bool _frame_put(struct _Frame *f, const void *data, size_t len) {
+  if (f->len + len > f->cap) {
+    size_t cap = f->cap ? f->cap * 2 : 4096;
+    while (cap < f->len + len) {
+      cap *= 2;
+    }
+    char *grown = realloc(f->data, cap);
+    if (!grown) {
+      return false;
+    }
+    f->data = grown;
+    f->cap = cap;
+  }
+  memcpy(f->data + f->len, data, len);
+  f->len += len;
+  return true;
+}
+
+// Send all of data, never raising SIGPIPE
+bool _send_all(int fd, const void *data, size_t len) {
+  const char *p = data;
+  while (len > 0) {
+    ssize_t n = send(fd, p, len, MSG_NOSIGNAL);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return false;
+    }
+    p += n;
+    len -= n;
+  }
+  return true;
+}
+
+// Read exactly len bytes
+bool _recv_all(int fd, void *data, size_t len) {
+  char *p = data;
+  while (len > 0) {
+    ssize_t n = recv(fd, p, len, 0);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return false;
+    }
+    p += n;
+    len -= n;
+  }
+  return true;
+}
+
+// Send a length-prefixed frame
+bool _send_frame(int fd, const void *data, size_t len) {
+  uint32_t size = len;
+  return _send_all(fd, &size, sizeof(size)) && _send_all(fd, data, len);
+}
+
+// Receive a length-prefixed frame, caller frees *data
+bool _recv_frame(int fd, char **data, size_t *len) {
+  uint32_t size;
+  if (!_recv_all(fd, &size, sizeof(size)) || size > DAEMON_MAX_FRAME) {
+    return false;
+  }
+
+  *data = malloc(size + 1);
+  if (!*data) {
+    return false;
+  }
+  if (!_recv_all(fd, *data, size)) {
+    free(*data);
+    return false;
+  }
+  (*data)[size] = '\0';
+  *len = size;
+  return true;
+}
+
+// Path of the daemon socket ($TD_SOCKET, or one per user)
+const char *daemon_socket_path(void) {
+  static char path[sizeof(((struct sockaddr_un *)0)->sun_path)];
+
+  const char *forced = getenv("TD_SOCKET");
+  const char *runtime = getenv("XDG_RUNTIME_DIR");
+  if (forced && *forced) {
+    snprintf(path, sizeof(path), "%s", forced);
+  } else if (runtime && *runtime) {
+    snprintf(path, sizeof(path), "%s/td.sock", runtime);
+  } else {
+    snprintf(path, sizeof(path), "/tmp/td-%u.sock", (unsigned)getuid());
+  }
+  return path;
+}
+
+// Open a socket connected to the daemon, -1 if nobody listens. A socket
+// or a daemon belonging to another user is never talked to, the path may
+// sit in a shared directory like /tmp.
+int _connect_socket(void) {
+  struct sockaddr_un addr = {.sun_family = AF_UNIX};
+  snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", daemon_socket_path());
+
+  struct stat st;
+  if (lstat(addr.sun_path, &st) != 0 || !S_ISSOCK(st.st_mode) ||
+      st.st_uid != getuid()) {
+    return -1;
+  }
+
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0) {
+    return -1;
+  }
+  if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+    close(fd);
+    return -1;
+  }
+
+  struct ucred cred;
+  socklen_t size = sizeof(cred);
+  if (getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &size) != 0 ||
+      cred.uid != getuid()) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+// Connect to a running daemon, -1 if there is none (or TD_NO_DAEMON is set)
+int daemon_connect(void) {
+  const char *off = getenv("TD_NO_DAEMON");
+  if (off && *off) {
+    return -1;
+  }
+  return _connect_socket();
+}
+
+// Send one request and wait for its reply, false if the daemon went away
+bool daemon_call(int fd, const char *op, const char *file_path,
+                 const char *value, enum Durability durability,
+                 struct DaemonReply *reply) {
+  struct _Frame req = {0};
+  char sync = (char)durability;
+  bool ok = _frame_put(&req, op, strlen(op) + 1) &&
+            _frame_put(&req, file_path, strlen(file_path) + 1) &&
+            _frame_put(&req, value, strlen(value) + 1) &&
+            _frame_put(&req, &sync, 1) && _send_frame(fd, req.data, req.len);
+  free(req.data);
+  if (!ok) {
+    return false;
+  }
+
+  char *data;
+  size_t len;
+  if (!_recv_frame(fd, &data, &len) || len == 0) {
+    return false;
+  }
+
+  // The first byte is the status, the rest is the payload
+  reply->ok = data[0] == 0;
+  reply->data = data;
+  memmove(data, data + 1, len - 1);
+  reply->len = len - 1;
+  reply->data[reply->len] = '\0';
+  return true;
+}
+
+// Turn the reply of a list request into a document and a table, the
+// document points into the reply and must not be closed
+bool daemon_tasks(const struct DaemonReply *reply, struct Document *doc,
+                  struct TodoTable *table) {
+  *table = (struct TodoTable){0};
+  *doc = (struct Document){0};
+
+  uint32_t count;
+  if (reply->len < sizeof(count)) {
+    return false;
+  }
+  memcpy(&count, reply->data, sizeof(count));
+
+  const size_t row = 9; // id, status, length
+  size_t rows = sizeof(count) + (size_t)count * row;
+  if (reply->len < rows) {
+    return false;
+  }
+
+  doc->data = reply->data + rows;
+  doc->size = reply->len - rows;
+
+  size_t offset = 0;
+  for (uint32_t i = 0; i < count; i++) {
+    const char *p = reply->data + sizeof(count) + (size_t)i * row;
+    uint32_t id, length;
+    memcpy(&id, p, 4);
+    memcpy(&length, p + 5, 4);
+    if (offset + length > doc->size) {
+      free_table(table);
+      return false;
+    }
+
+    Todo todo = {.id = id,
+                 .line = offset,
+                 .offset = offset,
+                 .length = length,
+                 .is_done = p[4] != 0};
+    if (!table_push(table, &todo)) {
+      free_table(table);
+      return false;
+    }
+    offset += length;
+  }
+  return true;
+}
+
+// Release a reply
+void daemon_reply_free(struct DaemonReply *reply) {
+  free(reply->data);
+  reply->data = NULL;
+  reply->len = 0;
+}
+
+// Serialize the tasks of a cached document as a list reply
+bool _serialize(struct _Cached *c) {
+  const struct TodoTable *t = &c->table;
+  struct _Frame *f = &c->list;
+  f->len = 0;
+
+  char status = 0;
+  uint32_t count = t->count;
+  bool ok = _frame_put(f, &status, 1) && _frame_put(f, &count, sizeof(count));
+
+  for (size_t i = 0; ok && i < t->count; i++) {
+    char row[9];
+    uint32_t id = t->ids[i], length = t->lengths[i];
+    memcpy(row, &id, 4);
+    row[4] = bitmap_get(t->done, i);
+    memcpy(row + 5, &length, 4);
+    ok = _frame_put(f, row, sizeof(row));
+  }
+  for (size_t i = 0; ok && i < t->count; i++) {
+    ok = _frame_put(f, c->doc.data + t->offsets[i], t->lengths[i]);
+  }
+  return ok;
+}
+
+// (Re)parse a cached document
+bool _cache_load(struct _Cached *c) {
+  free_table(&c->table);
+  doc_close(&c->doc);
+  c->stale = true;
+
+  if (!doc_load(&c->doc, c->path)) {
+    return false;
+  }
+  if (!load_todos(&c->doc, c->path, &c->table)) {
+    doc_close(&c->doc);
+    return false;
+  }
+  if (!_serialize(c)) {
+    return false;
+  }
+
+  c->stale = false;
+  return true;
+}
+
+// Release a cached document
+void _cache_drop(struct _Cached *c) {
+  free_table(&c->table);
+  doc_close(&c->doc);
+  free(c->list.data);
+  free(c->path);
+  free(c);
+}
+
+// Stop watching the directory of c unless another cached document is in it
+void _cache_unwatch(const struct _Cached *c) {
+  if (c->wd < 0) {
+    return;
+  }
+  for (size_t i = 0; i < cache_count; i++) {
+    if (cache[i] != c && cache[i]->wd == c->wd) {
+      return;
+    }
+  }
+  inotify_rm_watch(inotify_fd, c->wd);
+}
+
+// Find or load the cached document for an absolute path
+struct _Cached *_cache_get(const char *path) {
+  for (size_t i = 0; i < cache_count; i++) {
+    if (strcmp(cache[i]->path, path) == 0) {
+      if (cache[i]->stale && !_cache_load(cache[i])) {
+        return NULL;
+      }
+      return cache[i];
+    }
+  }
+
+  // Full cache, forget the oldest document
+  if (cache_count == DAEMON_MAX_DOCS) {
+    _cache_unwatch(cache[0]);
+    _cache_drop(cache[0]);
+    memmove(cache, cache + 1, --cache_count * sizeof(*cache));
+  }
+
+  struct _Cached *c = calloc(1, sizeof(*c));
+  if (!c || !(c->path = strdup(path))) {
+    free(c);
+    return NULL;
+  }
+  const char *slash = strrchr(c->path, '/');
+  c->base = slash ? slash + 1 : c->path;
+
+  // Watch the directory, editors often save by renaming over the file
+  char *dir = strndup(c->path, c->base - c->path);
+  c->wd = dir ? inotify_add_watch(inotify_fd, *dir ? dir : "/",
+                                  DAEMON_WATCH_MASK)
+              : -1;
+  free(dir);
+
+  if (!_cache_load(c)) {
+    _cache_unwatch(c);
+    _cache_drop(c);
+    return NULL;
+  }
+  cache[cache_count++] = c;
+  return c;
+}
+
+// Mark documents touched by the queued inotify events, then refresh them
+void _drain_events(void) {
+  char events[16 * 1024]
+      __attribute__((aligned(__alignof__(struct inotify_event))));
+
+  ssize_t n;
+  while ((n = read(inotify_fd, events, sizeof(events))) > 0) {
+    for (char *p = events; p < events + n;) {
+      struct inotify_event *ev = (struct inotify_event *)p;
+      // Events were dropped, any document may have changed
+      bool overflow = ev->wd == -1 && (ev->mask & IN_Q_OVERFLOW);
+      for (size_t i = 0; i < cache_count; i++) {
+        if (overflow ||
+            (cache[i]->wd == ev->wd &&
+             (ev->len == 0 || strcmp(ev->name, cache[i]->base) == 0 ||
+              is_journal_of(ev->name, cache[i]->base)))) {
+          cache[i]->stale = true;
+        }
+      }
+      p += sizeof(*ev) + ev->len;
+    }
+  }
+
+  // Reparse now so the next request is answered from memory
+  for (size_t i = 0; i < cache_count; i++) {
+    if (cache[i]->stale) {
+      _cache_load(cache[i]);
+    }
+  }
+}
+
+// Reply with a status and a message
+bool _reply(int fd, bool ok, const char *message) {
+  struct _Frame f = {0};
+  char status = ok ? 0 : 1;
+  bool sent = _frame_put(&f, &status, 1) &&
+              _frame_put(&f, message, strlen(message)) &&
+              _send_frame(fd, f.data, f.len);
+  free(f.data);
+  return sent;
+}
+
+// Answer one request
+bool _handle(int fd, char *req, size_t len) {
+  // op, path and value are NUL terminated, the durability byte follows
+  char *op = req;
+  char *path = op + strlen(op) + 1;
+  char *value = path < req + len ? path + strlen(path) + 1 : req + len;
+  if (value >= req + len) {
+    return _reply(fd, false, "Malformed request");
+  }
+  char *sync = value + strlen(value) + 1;
+  enum Durability durability =
+      sync < req + len && *sync <= DURABILITY_DIR ? (enum Durability)*sync
+                                                  : DURABILITY_NONE;
+
+  char message[PATH_MAX + 32];
+
+  if (strcmp(op, "list") == 0) {
+    struct _Cached *c = _cache_get(path);
+    if (!c) {
+      return _reply(fd, false, "Could not read the file");
+    }
+    return _send_frame(fd, c->list.data, c->list.len);
+  }
+
+  bool ok = false;
+  if (strcmp(op, "add") == 0) {
+    ok = add_todo(path, value, false);
+  } else if (strcmp(op, "done") == 0 || strcmp(op, "undone") == 0 ||
+             strcmp(op, "remove") == 0) {
+    struct Selector sel;
+    if (!selector_parse(&sel, value)) {
+      return _reply(fd, false, "Invalid ID selector");
+    }
+    ok = strcmp(op, "remove") == 0
+             ? remove_todos(path, &sel, durability)
+             : set_status(path, &sel, strcmp(op, "done") == 0, durability);
+    selector_free(&sel);
+  } else {
+    return _reply(fd, false, "Unknown request");
+  }
+
+  // The client prints its own confirmation, only failures carry a message
+  message[0] = '\0';
+  if (!ok) {
+    snprintf(message, sizeof(message), "Could not update %s", path);
+  }
+
+  // The write also shows up through inotify, refresh right away anyway
+  for (size_t i = 0; i < cache_count; i++) {
+    if (strcmp(cache[i]->path, path) == 0) {
+      _cache_load(cache[i]);
+    }
+  }
+  return _reply(fd, ok, message);
+}
+
+// Run the daemon in the foreground until it is killed
+bool daemon_serve(void) {
+  const char *path = daemon_socket_path();
+
+  int probe = _connect_socket();
+  if (probe >= 0) {
+    close(probe);
+    print_err("A td daemon is already running");
+    return false;
+  }
+  unlink(path); // Left behind by a daemon that died
+
+  struct sockaddr_un addr = {.sun_family = AF_UNIX};
+  snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", path);
+
+  int listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  mode_t mask = umask(0077); // Only this user may talk to the daemon
+  bool bound = listen_fd >= 0 &&
+               bind(listen_fd, (struct sockaddr *)&addr, sizeof(addr)) == 0 &&
+               listen(listen_fd, DAEMON_MAX_CLIENTS) == 0;
+  umask(mask);
+
+  inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (!bound || inotify_fd < 0) {
+    print_err(strerror(errno));
+    if (listen_fd >= 0) {
+      close(listen_fd);
+    }
+    return false;
+  }
+
+  signal(SIGPIPE, SIG_IGN);
+  print_info("Serving on %s", path);
+  fflush(stdout);
+
+  struct pollfd fds[DAEMON_MAX_CLIENTS + 2] = {
+      {.fd = listen_fd, .events = POLLIN},
+      {.fd = inotify_fd, .events = POLLIN},
+  };
+  size_t nfds = 2;
+
+  while (true) {
+    if (poll(fds, nfds, -1) < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      print_err(strerror(errno));
+      break;
+    }
+
+    if (fds[1].revents & POLLIN) {
+      _drain_events();
+    }
+
+    for (size_t i = 2; i < nfds; i++) {
+      if (!fds[i].revents) {
+        continue;
+      }
+
+      char *req;
+      size_t len;
+      bool keep = (fds[i].revents & POLLIN) &&
+                  _recv_frame(fds[i].fd, &req, &len);
+      if (keep) {
+        keep = _handle(fds[i].fd, req, len);
+        free(req);
+      }
+      if (!keep) {
+        close(fds[i].fd);
+        fds[i--] = fds[--nfds];
+      }
+    }
+
+    if ((fds[0].revents & POLLIN) && nfds < DAEMON_MAX_CLIENTS + 2) {
+      int client = accept4(listen_fd, NULL, NULL, SOCK_CLOEXEC);
+      if (client >= 0) {
+        // A stuck client must not stall everybody else for long
+        struct timeval timeout = {.tv_sec = 1};
+        setsockopt(client, SOL_SOCKET, SO_RCVTIMEO, &timeout,
+                   sizeof(timeout));
+        fds[nfds++] = (struct pollfd){.fd = client, .events = POLLIN};
+      }
+    }
+  }
+
+  close(listen_fd);
+  unlink(path);
+  return false;
+}
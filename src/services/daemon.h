@@ -0,0 +1,62 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2025 Võ Quang Chiến
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef DAEMON_H
+#define DAEMON_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "storage.h"
+#include "writer.h"
+
+// Reply to one request
+struct DaemonReply {
+  bool ok;
+  char *data; // Message, or the serialized tasks of a list request
+  size_t len;
+};
+
+// Path of the daemon socket ($TD_SOCKET, or one per user)
+const char *daemon_socket_path(void);
+
+// Run the daemon in the foreground until it is killed
+bool daemon_serve(void);
+
+// Connect to a running daemon, -1 if there is none (or TD_NO_DAEMON is set)
+int daemon_connect(void);
+
+// Send one request and wait for its reply, false if the daemon went away
+bool daemon_call(int fd, const char *op, const char *file_path,
+                 const char *value, enum Durability durability,
+                 struct DaemonReply *reply);
+
+// Turn the reply of a list request into a document and a table
+bool daemon_tasks(const struct DaemonReply *reply, struct Document *doc,
+                  struct TodoTable *table);
+
+// Release a reply
+void daemon_reply_free(struct DaemonReply *reply);
+
+#endif
@@ -0,0 +1,135 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2025 Võ Quang Chiến
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "filter.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "../utils/fmt.h"
+#include "meta.h"
+
+// Keep only tasks with the status called name (open, done)
+bool filter_status(struct Filter *f, const char *name) {
+  if (strcmp(name, "open") == 0) {
+    f->status = FILTER_OPEN;
+  } else if (strcmp(name, "done") == 0) {
+    f->status = FILTER_DONE;
+  } else {
+    print_err("Invalid status, expected open or done.");
+    return false;
+  }
+  return true;
+}
+
+// Keep only tasks whose content contains text
+void filter_text(struct Filter *f, const char *text) {
+  f->text = text;
+  f->text_len = strlen(text);
+  f->data = NULL;
+}
+
+// Keep only tasks tagged "#tag", the '#' may be left out
+void filter_tag(struct Filter *f, const char *tag) {
+  f->tag = tag + (tag[0] == '#');
+  f->tag_len = strlen(f->tag);
+}
+
+// Keep only tasks whose content matches the extended regex pattern
+bool filter_regex(struct Filter *f, const char *pattern) {
+  if (f->has_regex) {
+    regfree(&f->regex);
+    f->has_regex = false;
+  }
+
+  int err = regcomp(&f->regex, pattern, REG_EXTENDED | REG_NOSUB);
+  if (err != 0) {
+    char message[256];
+    regerror(err, &f->regex, message, sizeof(message));
+    print_err(message);
+    return false;
+  }
+  f->has_regex = true;
+  return true;
+}
+
+// True if the filter drops anything
+bool filter_active(const struct Filter *f) {
+  return f->status != FILTER_ANY || f->text_len > 0 || f->has_regex ||
+         f->tag_len > 0;
+}
+
+// True if text occurs inside data[offset, offset + length)
+bool _contains(struct Filter *f, const char *data, size_t size, size_t offset,
+               size_t length) {
+  // One memmem call runs ahead to the next occurrence anywhere in the
+  // document, every task before it is rejected without looking at it
+  if (f->data != data || f->next < offset) {
+    const char *hit =
+        memmem(data + offset, size - offset, f->text, f->text_len);
+    f->data = data;
+    f->next = hit ? (size_t)(hit - data) : SIZE_MAX;
+  }
+
+  // The first occurrence at or after offset is the only one that can fit
+  return f->next != SIZE_MAX && f->next + f->text_len <= offset + length;
+}
+
+// True if the task whose content is data[offset, offset + length) passes.
+// Tasks of one document must be tested in file order.
+bool filter_match(struct Filter *f, const char *data, size_t size,
+                  size_t offset, size_t length, bool is_done) {
+  if ((f->status == FILTER_OPEN && is_done) ||
+      (f->status == FILTER_DONE && !is_done)) {
+    return false;
+  }
+
+  if (f->text_len > 0 && !_contains(f, data, size, offset, length)) {
+    return false;
+  }
+
+  if (f->tag_len > 0 &&
+      !meta_has_tag(data + offset, length, f->tag, f->tag_len)) {
+    return false;
+  }
+
+  if (f->has_regex) {
+    // Match in place, the content is not NUL terminated
+    regmatch_t span = {.rm_so = 0, .rm_eo = length};
+    if (regexec(&f->regex, data + offset, 1, &span, REG_STARTEND) != 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Release a filter
+void filter_free(struct Filter *f) {
+  if (f->has_regex) {
+    regfree(&f->regex);
+  }
+  *f = (struct Filter){0};
+}
@@ -0,0 +1,76 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2025 Võ Quang Chiến
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef FILTER_H
+#define FILTER_H
+
+#include <regex.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// Which statuses a filter keeps
+enum FilterStatus {
+  FILTER_ANY,
+  FILTER_OPEN,
+  FILTER_DONE,
+};
+
+// Conditions a task must meet to be listed, all of them at once. Zero
+// initialize it, then add conditions.
+struct Filter {
+  enum FilterStatus status;
+  const char *text; // Substring the content must contain
+  size_t text_len;
+  bool has_regex;
+  regex_t regex; // Extended regex the content must match
+  const char *tag; // Tag the content must carry, without its '#'
+  size_t tag_len;
+  const char *data; // Document the search below refers to
+  size_t next;      // Offset of the next occurrence of text in data
+};
+
+// Keep only tasks with the status called name (open, done)
+bool filter_status(struct Filter *f, const char *name);
+
+// Keep only tasks whose content contains text
+void filter_text(struct Filter *f, const char *text);
+
+// Keep only tasks tagged "#tag", the '#' may be left out
+void filter_tag(struct Filter *f, const char *tag);
+
+// Keep only tasks whose content matches the extended regex pattern
+bool filter_regex(struct Filter *f, const char *pattern);
+
+// True if the filter drops anything
+bool filter_active(const struct Filter *f);
+
+// True if the task whose content is data[offset, offset + length) passes.
+// Tasks of one document must be tested in file order.
+bool filter_match(struct Filter *f, const char *data, size_t size,
+                  size_t offset, size_t length, bool is_done);
+
+// Release a filter
+void filter_free(struct Filter *f);
+
+#endif
@@ -0,0 +1,192 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2025 Võ Quang Chiến
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "index.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "../utils/fmt.h"
+#include "../utils/stats.h"
+#include "writer.h"
+
+// Path of the sidecar "<dir>/.<base>.<ext>" of file_path, caller frees it
+char *sidecar_path(const char *file_path, const char *ext) {
+  const char *slash = strrchr(file_path, '/');
+  size_t dir_len = slash ? (size_t)(slash - file_path) + 1 : 0;
+
+  size_t size = strlen(file_path) + strlen(ext) + 3;
+  char *path = malloc(size);
+  if (path) {
+    snprintf(path, size, "%.*s.%s.%s", (int)dir_len, file_path,
+             file_path + dir_len, ext);
+  }
+  return path;
+}
+
+// Path of the sidecar index for file_path, caller frees it
+char *index_path(const char *file_path) {
+  return sidecar_path(file_path, "tdidx");
+}
+
+// True if file_path has a sidecar index, stale or not
+bool index_exists(const char *file_path) {
+  char *path = index_path(file_path);
+  bool exists = path && access(path, F_OK) == 0;
+  free(path);
+  return exists;
+}
+
+// Copy the identity of st into the header
+void _stamp_header(struct IndexHeader *header, const struct stat *st) {
+  header->size = st->st_size;
+  header->mtime_sec = st->st_mtim.tv_sec;
+  header->mtime_nsec = st->st_mtim.tv_nsec;
+  header->ino = st->st_ino;
+  header->dev = st->st_dev;
+}
+
+// True if the header describes the file st was taken from
+bool _header_matches(const struct IndexHeader *header, const struct stat *st) {
+  return header->size == (uint64_t)st->st_size &&
+         header->mtime_sec == st->st_mtim.tv_sec &&
+         header->mtime_nsec == st->st_mtim.tv_nsec &&
+         header->ino == st->st_ino && header->dev == st->st_dev;
+}
+
+// Map the index of file_path, fail if it is missing or does not match st
+bool index_open(struct Index *idx, const char *file_path,
+                const struct stat *st) {
+  *idx = (struct Index){.fd = -1};
+
+  char *path = index_path(file_path);
+  if (!path) {
+    return false;
+  }
+  int fd = open(path, O_RDWR);
+  free(path);
+  if (fd < 0) {
+    return false;
+  }
+  stats_add(STAT_OPENS, 1);
+
+  struct stat ist;
+  if (fstat(fd, &ist) != 0 ||
+      (size_t)ist.st_size < sizeof(struct IndexHeader)) {
+    close(fd);
+    return false;
+  }
+
+  void *map =
+      mmap(NULL, ist.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (map == MAP_FAILED) {
+    close(fd);
+    return false;
+  }
+  stats_add(STAT_BYTES_READ, ist.st_size);
+
+  struct IndexHeader *header = map;
+  size_t count = (ist.st_size - sizeof(*header)) / sizeof(struct IndexEntry);
+  if (memcmp(header->magic, INDEX_MAGIC, sizeof(header->magic)) != 0 ||
+      header->count != count || !_header_matches(header, st)) {
+    munmap(map, ist.st_size);
+    close(fd);
+    return false;
+  }
+
+  idx->fd = fd;
+  idx->map_size = ist.st_size;
+  idx->header = header;
+  idx->entries = (struct IndexEntry *)(header + 1);
+  idx->count = count;
+  return true;
+}
+
+// Unmap an index opened with index_open
+void index_close(struct Index *idx) {
+  if (idx->header) {
+    munmap(idx->header, idx->map_size);
+  }
+  if (idx->fd >= 0) {
+    close(idx->fd);
+  }
+  *idx = (struct Index){.fd = -1};
+}
+
+// Record the current identity of file_path after an in-place change
+bool index_stamp(struct Index *idx, const char *file_path) {
+  struct stat st;
+  if (stat(file_path, &st) != 0) {
+    return false;
+  }
+  _stamp_header(idx->header, &st);
+  return true;
+}
+
+// Replace the index of file_path with the given entries, parsed from the
+// version of the file st describes
+bool index_write(const char *file_path, const struct stat *st,
+                 const struct IndexEntry *entries, size_t count) {
+  struct IndexHeader header = {.count = count};
+  memcpy(header.magic, INDEX_MAGIC, sizeof(header.magic));
+  _stamp_header(&header, st);
+
+  char *path = index_path(file_path);
+  if (!path) {
+    print_err("Memory allocation failed");
+    return false;
+  }
+
+  struct Writer w;
+  bool ok = writer_open(&w, path, DURABILITY_NONE);
+  free(path);
+  if (!ok) {
+    return false;
+  }
+
+  writer_write(&w, &header, sizeof(header));
+  writer_write(&w, entries, count * sizeof(*entries));
+  return writer_commit(&w);
+}
+
+// Append one entry to a valid index and restamp it
+bool index_append(struct Index *idx, const char *file_path,
+                  const struct IndexEntry *entry) {
+  off_t end = sizeof(struct IndexHeader) + idx->count * sizeof(*entry);
+  stats_add(STAT_BYTES_WRITTEN, sizeof(*entry));
+  if (pwrite(idx->fd, entry, sizeof(*entry), end) != sizeof(*entry)) {
+    return false;
+  }
+
+  // The new entry is outside the mapping, only the header changes in place
+  idx->header->count = ++idx->count;
+  return index_stamp(idx, file_path);
+}
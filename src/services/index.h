@@ -0,0 +1,94 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2025 Võ Quang Chiến
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef INDEX_H
+#define INDEX_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/stat.h>
+
+// Constants
+#define INDEX_MAGIC "TDIDX\0\0\1"
+#define INDEX_DONE 1 // Entry flag, the task is completed
+
+// Identity of the TODO file the index was built from
+struct IndexHeader {
+  char magic[8];
+  uint64_t size;
+  int64_t mtime_sec;
+  int64_t mtime_nsec;
+  uint64_t ino;
+  uint64_t dev;
+  uint64_t count;
+};
+
+// Location of one task, the task with ID n is entry n - 1
+struct IndexEntry {
+  uint64_t line;    // Offset of the task line
+  uint32_t length;  // Length of the line without the newline
+  uint16_t content; // Offset of the content inside the line
+  uint8_t mark;     // Offset of the status byte inside the line
+  uint8_t flags;
+};
+
+// Sidecar index mapped into memory
+struct Index {
+  int fd;
+  size_t map_size;
+  struct IndexHeader *header;
+  struct IndexEntry *entries;
+  size_t count;
+};
+
+// Path of the sidecar index for file_path, caller frees it
+char *index_path(const char *file_path);
+
+// Path of the sidecar "<dir>/.<base>.<ext>" of file_path, caller frees it
+char *sidecar_path(const char *file_path, const char *ext);
+
+// True if file_path has a sidecar index, stale or not
+bool index_exists(const char *file_path);
+
+// Map the index of file_path, fail if it is missing or does not match st
+bool index_open(struct Index *idx, const char *file_path,
+                const struct stat *st);
+
+// Unmap an index opened with index_open
+void index_close(struct Index *idx);
+
+// Record the current identity of file_path after an in-place change
+bool index_stamp(struct Index *idx, const char *file_path);
+
+// Replace the index of file_path with the given entries, parsed from the
+// version of the file st describes
+bool index_write(const char *file_path, const struct stat *st,
+                 const struct IndexEntry *entries, size_t count);
+
+// Append one entry to a valid index and restamp it
+bool index_append(struct Index *idx, const char *file_path,
+                  const struct IndexEntry *entry);
+
+#endif
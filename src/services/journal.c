@@ -0,0 +1,303 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2025 Võ Quang Chiến
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "journal.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "../utils/fmt.h"
+#include "../utils/stats.h"
+#include "index.h"
+
+// Constants
+#define JOURNAL_HEADER_MAX 128
+#define JOURNAL_COMPACT_MIN (1 << 20) // Never compact a smaller journal
+#define JOURNAL_COMPACT_RATIO 4 // Compact past 1/4 of the file size
+#define JOURNAL_COMPACT_TRIES 8
+
+// Set by --journal
+static bool journal_mode = false;
+
+// Append mutations to a journal instead of rewriting files
+void set_journal_mode(bool on) { journal_mode = on; }
+
+// First line of a journal for the file st was taken from
+int _journal_header(const struct stat *st, char *out) {
+  return snprintf(out, JOURNAL_HEADER_MAX, "tdlog %llu %lld.%09ld %llu %llu\n",
+                  (unsigned long long)st->st_size,
+                  (long long)st->st_mtim.tv_sec, st->st_mtim.tv_nsec,
+                  (unsigned long long)st->st_ino,
+                  (unsigned long long)st->st_dev);
+}
+
+// True if the journal open at fd applies to the file st was taken from
+bool _journal_matches(int fd, const struct stat *st) {
+  char expected[JOURNAL_HEADER_MAX], found[JOURNAL_HEADER_MAX];
+  int len = _journal_header(st, expected);
+  return pread(fd, found, len, 0) == len && memcmp(found, expected, len) == 0;
+}
+
+// Size of the journal of file_path, 0 if it has none
+size_t journal_size(const char *file_path) {
+  char *path = sidecar_path(file_path, "tdlog");
+  struct stat st;
+  bool found = path && stat(path, &st) == 0;
+  free(path);
+  return found ? (size_t)st.st_size : 0;
+}
+
+// Delete the journal of file_path
+void journal_remove(const char *file_path) {
+  char *path = sidecar_path(file_path, "tdlog");
+  if (path) {
+    unlink(path);
+    free(path);
+  }
+}
+
+// True if mutations of file_path go to its journal, because journal mode is
+// on or a journal is pending. Drops a stale journal. Call with the file
+// locked.
+bool journal_wanted(const char *file_path) {
+  char *path = sidecar_path(file_path, "tdlog");
+  int fd = path ? open(path, O_RDONLY | O_CLOEXEC) : -1;
+  free(path);
+  if (fd < 0) {
+    return journal_mode;
+  }
+  stats_add(STAT_OPENS, 1);
+
+  struct stat st;
+  bool valid = stat(file_path, &st) == 0 && _journal_matches(fd, &st);
+  close(fd);
+  if (valid) {
+    return true;
+  }
+
+  print_err("The file changed outside td, its pending journal was dropped");
+  journal_remove(file_path);
+  return journal_mode;
+}
+
+// Append one operation to the journal of file_path, creating it if needed.
+// value is NULL for operations without an argument. Call with the file
+// locked.
+bool journal_append(const char *file_path, const char *op, const char *value,
+                    enum Durability durability) {
+  if (value && strchr(value, '\n')) {
+    print_err("Journaled tasks must fit on one line");
+    return false;
+  }
+
+  struct stat st;
+  char *path = sidecar_path(file_path, "tdlog");
+  if (!path || stat(file_path, &st) != 0) {
+    print_err(path ? strerror(errno) : "Memory allocation failed");
+    free(path);
+    return false;
+  }
+
+  int fd = open(path, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0666);
+  free(path);
+  struct stat jst;
+  if (fd < 0 || fstat(fd, &jst) != 0) {
+    print_err(strerror(errno));
+    if (fd >= 0) {
+      close(fd);
+    }
+    return false;
+  }
+  stats_add(STAT_OPENS, 1);
+
+  // A new journal starts with its header, both go out in one write
+  char header[JOURNAL_HEADER_MAX];
+  int header_len = jst.st_size == 0 ? _journal_header(&st, header) : 0;
+  char *record = NULL;
+  int len = asprintf(&record, "%.*s%s%s%s\n", header_len, header, op,
+                     value ? " " : "", value ? value : "");
+  if (len < 0) {
+    print_err("Memory allocation failed");
+    close(fd);
+    return false;
+  }
+
+  stats_add(STAT_BYTES_WRITTEN, len);
+  bool ok = write(fd, record, len) == len;
+  free(record);
+  if (!ok) {
+    print_err(strerror(errno));
+  }
+
+  stats_add(STAT_FSYNCS, ok && durability >= DURABILITY_FILE);
+  if (ok && durability >= DURABILITY_FILE && fdatasync(fd) != 0) {
+    print_err(strerror(errno));
+    ok = false;
+  }
+  if (ok && header_len > 0 && durability >= DURABILITY_DIR &&
+      !sync_parent(file_path)) {
+    print_err(strerror(errno));
+    ok = false;
+  }
+
+  close(fd);
+  return ok;
+}
+
+// Read the whole journal open at fd into a NUL terminated buffer
+char *_read_journal(int fd, size_t size) {
+  char *data = malloc(size + 1);
+  if (!data) {
+    return NULL;
+  }
+
+  size_t len = 0;
+  while (len < size) {
+    ssize_t n = pread(fd, data + len, size - len, len);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      free(data);
+      return NULL;
+    }
+    len += n;
+  }
+  stats_add(STAT_BYTES_READ, size);
+  data[size] = '\0';
+  return data;
+}
+
+// Apply the journal over a batch batch_open just loaded
+bool journal_replay(struct Batch *b) {
+  char *path = sidecar_path(b->path, "tdlog");
+  int fd = path ? open(path, O_RDONLY | O_CLOEXEC) : -1;
+  free(path);
+  if (fd < 0) {
+    b->journal_size = 0;
+    return true;
+  }
+  stats_add(STAT_OPENS, 1);
+
+  // The size is remembered even for a stale journal, so the commit that
+  // rewrites the file also removes it
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    close(fd);
+    b->journal_size = 0;
+    return true;
+  }
+  b->journal_size = st.st_size;
+  if (!_journal_matches(fd, &b->doc.st)) {
+    close(fd);
+    return true;
+  }
+
+  size_t span = stats_begin("replay");
+  char *data = _read_journal(fd, st.st_size);
+  close(fd);
+  if (!data) {
+    print_err("Could not read the journal");
+    stats_end(span);
+    return false;
+  }
+
+  // A line without its newline is a write cut short, it never happened
+  char *line = strchr(data, '\n') + 1;
+  char *end;
+  while ((end = strchr(line, '\n'))) {
+    *end = '\0';
+    char *value = strchr(line, ' ');
+    if (value) {
+      *value++ = '\0';
+    }
+    if (!batch_apply(b, line, value ? value : "")) {
+      print_err("Skipped an invalid journal record");
+    }
+    line = end + 1;
+  }
+
+  free(data);
+  stats_end(span);
+  return true;
+}
+
+// Fold the journal back into file_path with one atomic rewrite
+bool journal_compact(const char *file_path, enum Durability durability) {
+  // A record appended after the journal was read makes the commit fail,
+  // read it again and retry
+  for (int attempt = 0; attempt < JOURNAL_COMPACT_TRIES; attempt++) {
+    struct Batch b;
+    if (!batch_open(&b, file_path)) {
+      return false;
+    }
+
+    errno = 0;
+    bool ok = batch_commit(&b, durability);
+    int err = errno;
+    batch_close(&b);
+    if (ok || err != EAGAIN) {
+      return ok;
+    }
+  }
+  return false;
+}
+
+// Compact once the journal has grown past its threshold
+void journal_settle(const char *file_path, enum Durability durability) {
+  struct stat st;
+  size_t size = journal_size(file_path);
+  if (size < JOURNAL_COMPACT_MIN || stat(file_path, &st) != 0 ||
+      size < (size_t)st.st_size / JOURNAL_COMPACT_RATIO) {
+    return;
+  }
+  journal_compact(file_path, durability);
+}
+
+// True if name is the journal of the file named base
+bool is_journal_of(const char *name, const char *base) {
+  size_t len = strlen(base);
+  return name[0] == '.' && strncmp(name + 1, base, len) == 0 &&
+         strcmp(name + 1 + len, ".tdlog") == 0;
+}
+
+// Map file_path with its journal applied, the document readers should see
+bool doc_load(struct Document *doc, const char *file_path) {
+  if (journal_size(file_path) == 0) {
+    return doc_open(doc, file_path);
+  }
+
+  struct Batch b;
+  if (!batch_open(&b, file_path)) {
+    return false;
+  }
+  bool ok = batch_snapshot(&b, doc);
+  batch_close(&b);
+  return ok;
+}
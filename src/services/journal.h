@@ -0,0 +1,76 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2025 Võ Quang Chiến
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "batch.h"
+#include "storage.h"
+#include "writer.h"
+
+// Mutations can go to an append-only journal ".<base>.tdlog" next to the
+// TODO file instead of rewriting it. Each record is one line of the batch
+// script language, so a mutation costs one small append. The first line
+// names the file the records apply to; a journal whose file changed under
+// it is stale and gets dropped.
+
+// Append mutations to a journal instead of rewriting files
+void set_journal_mode(bool on);
+
+// True if mutations of file_path go to its journal, because journal mode is
+// on or a journal is pending. Drops a stale journal. Call with the file
+// locked.
+bool journal_wanted(const char *file_path);
+
+// Size of the journal of file_path, 0 if it has none
+size_t journal_size(const char *file_path);
+
+// Append one operation to the journal of file_path, creating it if needed.
+// value is NULL for operations without an argument. Call with the file
+// locked.
+bool journal_append(const char *file_path, const char *op, const char *value,
+                    enum Durability durability);
+
+// Apply the journal over a batch batch_open just loaded
+bool journal_replay(struct Batch *b);
+
+// Delete the journal of file_path
+void journal_remove(const char *file_path);
+
+// Fold the journal back into file_path with one atomic rewrite
+bool journal_compact(const char *file_path, enum Durability durability);
+
+// Compact once the journal has grown past its threshold
+void journal_settle(const char *file_path, enum Durability durability);
+
+// True if name is the journal of the file named base, for directory events
+bool is_journal_of(const char *name, const char *base);
+
+// Map file_path with its journal applied, the document readers should see
+bool doc_load(struct Document *doc, const char *file_path);
+
+#endif
@@ -0,0 +1,94 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2025 Võ Quang Chiến
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "lock.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <unistd.h>
+
+#include "../utils/fmt.h"
+#include "../utils/stats.h"
+#include "index.h"
+
+// Take the lock of file_path with flock operation op, print errors unless
+// quiet
+bool _lock(struct Lock *lock, const char *file_path, int op, bool quiet) {
+  lock->fd = -1;
+
+  char *path = sidecar_path(file_path, "tdlock");
+  if (!path) {
+    if (!quiet) {
+      print_err("Memory allocation failed");
+    }
+    return false;
+  }
+
+  // The lock file is never removed, unlinking it would let two writers
+  // hold locks on different inodes
+  int fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0666);
+  free(path);
+  if (fd < 0) {
+    if (!quiet) {
+      print_err(strerror(errno));
+    }
+    return false;
+  }
+  stats_add(STAT_OPENS, 1);
+
+  while (flock(fd, op) != 0) {
+    if (errno != EINTR) {
+      if (!quiet) {
+        print_err(strerror(errno));
+      }
+      close(fd);
+      return false;
+    }
+  }
+
+  lock->fd = fd;
+  return true;
+}
+
+// Block until this process is the only writer of file_path
+bool lock_acquire(struct Lock *lock, const char *file_path) {
+  return _lock(lock, file_path, LOCK_EX, false);
+}
+
+// Become the only writer of file_path if no other writer is in, false
+// without a message otherwise. Readers use it for optional index upkeep.
+bool lock_try(struct Lock *lock, const char *file_path) {
+  return _lock(lock, file_path, LOCK_EX | LOCK_NB, true);
+}
+
+// Let the next writer in
+void lock_release(struct Lock *lock) {
+  if (lock->fd >= 0) {
+    close(lock->fd); // Closing the last descriptor drops the flock
+    lock->fd = -1;
+  }
+}
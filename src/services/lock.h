@@ -0,0 +1,47 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2025 Võ Quang Chiến
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef LOCK_H
+#define LOCK_H
+
+#include <stdbool.h>
+
+// Exclusive writer lock on a TODO file. It is held on the sidecar
+// ".<base>.tdlock" because every rewrite renames a new inode over the file
+// itself. Readers only ever try it, to rewrite a stale index.
+struct Lock {
+  int fd;
+};
+
+// Block until this process is the only writer of file_path
+bool lock_acquire(struct Lock *lock, const char *file_path);
+
+// Become the only writer of file_path if no other writer is in, false
+// without a message otherwise. Readers use it for optional index upkeep.
+bool lock_try(struct Lock *lock, const char *file_path);
+
+// Let the next writer in
+void lock_release(struct Lock *lock);
+
+#endif
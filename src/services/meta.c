@@ -0,0 +1,366 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2025 Võ Quang Chiến
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "meta.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "../utils/bitmap.h"
+#include "../utils/fmt.h"
+
+// Constants
+#define ONES 0x0101010101010101ull
+#define HIGHS 0x8080808080808080ull
+#define RADIX_BITS 12 // Priority and due date together sort in two passes
+#define RADIX_BUCKETS (1 << RADIX_BITS)
+
+// Bits each sort field takes in the packed key, IDs need none
+static const int field_bits[] = {
+    [SORT_PRIORITY] = 4,
+    [SORT_DUE] = 20,
+    [SORT_STATUS] = 1,
+    [SORT_ID] = 0,
+};
+
+// Parse comma separated sort keys (priority, due, status, id), a leading
+// "-" reverses one
+bool parse_sort(const char *text, struct SortSpec *spec) {
+  static const char *names[] = {
+      [SORT_PRIORITY] = "priority",
+      [SORT_DUE] = "due",
+      [SORT_STATUS] = "status",
+      [SORT_ID] = "id",
+  };
+
+  *spec = (struct SortSpec){0};
+  while (*text) {
+    bool descending = *text == '-';
+    text += descending;
+    size_t len = strcspn(text, ",");
+
+    size_t field = 0;
+    while (field < sizeof(names) / sizeof(*names) &&
+           (strlen(names[field]) != len ||
+            strncmp(text, names[field], len) != 0)) {
+      field++;
+    }
+    if (field == sizeof(names) / sizeof(*names) ||
+        spec->count == SORT_MAX_KEYS) {
+      print_err("Invalid sort key, expected priority, due, status or id.");
+      return false;
+    }
+    for (size_t k = 0; k < spec->count; k++) {
+      if (spec->fields[k] == field) {
+        print_err("Sort key given twice.");
+        return false;
+      }
+    }
+
+    spec->fields[spec->count] = field;
+    spec->descending[spec->count++] = descending;
+    text += len + (text[len] == ',');
+  }
+  return spec->count > 0;
+}
+
+// Days from 1970-01-01 to a date of the proleptic Gregorian calendar
+int64_t _days_from_civil(int64_t y, unsigned m, unsigned d) {
+  y -= m <= 2;
+  int64_t era = (y >= 0 ? y : y - 399) / 400;
+  unsigned yoe = (unsigned)(y - era * 400);
+  unsigned doy = (153 * (m + (m > 2 ? -3 : 9)) + 2) / 5 + d - 1;
+  unsigned doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;
+  return era * 146097 + (int64_t)doe - 719468;
+}
+
+// Parse n decimal digits at p, -1 if one is missing
+int _digits(const char *p, int n) {
+  int value = 0;
+  for (int i = 0; i < n; i++) {
+    if (p[i] < '0' || p[i] > '9') {
+      return -1;
+    }
+    value = value * 10 + (p[i] - '0');
+  }
+  return value;
+}
+
+// Due date of the token "@due(YYYY-MM-DD)" starting at p with room bytes
+// left, META_NO_DUE if it is not one
+uint32_t _parse_due(const char *p, size_t room) {
+  if (room < 16 || memcmp(p, "@due(", 5) != 0 || p[9] != '-' ||
+      p[12] != '-' || p[15] != ')') {
+    return META_NO_DUE;
+  }
+  int year = _digits(p + 5, 4);
+  int month = _digits(p + 10, 2);
+  int day = _digits(p + 13, 2);
+  if (year < 0 || month < 1 || month > 12 || day < 1 || day > 31) {
+    return META_NO_DUE;
+  }
+
+  int64_t days = _days_from_civil(year, month, day);
+  if (days < 0) {
+    return 0;
+  }
+  return days < META_NO_DUE ? (uint32_t)days : META_NO_DUE - 1;
+}
+
+// Bit set in the high bit of every byte of word equal to c
+static inline uint64_t _bytes_equal(uint64_t word, unsigned char c) {
+  uint64_t x = word ^ (ONES * c);
+  return (x - ONES) & ~x & HIGHS;
+}
+
+// True if p starts a token, at the start of the text or after a space
+static inline bool _token_start(const char *text, const char *p) {
+  return p == text || p[-1] == ' ' || p[-1] == '\t';
+}
+
+// True if the token of n bytes at p ends there
+static inline bool _token_end(const char *p, size_t n, const char *end) {
+  return p + n == end || p[n] == ' ' || p[n] == '\t' || p[n] == '\r';
+}
+
+// Read the token at p, if it is a priority or a due date not seen yet
+static inline void _token(const char *text, const char *p, const char *end,
+                          uint8_t *priority, uint32_t *due) {
+  if (!_token_start(text, p)) {
+    return;
+  }
+  if (*p == '!' && end - p >= 3 && p[1] == 'p' && p[2] >= '0' &&
+      p[2] <= '9' && _token_end(p, 3, end) && *priority == META_NO_PRIORITY) {
+    *priority = p[2] - '0';
+  } else if (*p == '@' && *due == META_NO_DUE) {
+    *due = _parse_due(p, end - p);
+  }
+}
+
+// Fill the metadata of one task from its text
+void _extract(const char *text, size_t len, uint8_t *priority,
+              uint32_t *due) {
+  *priority = META_NO_PRIORITY;
+  *due = META_NO_DUE;
+
+  // Words without a '!' or '@' are skipped whole, the last one is padded
+  // with zeros
+  const char *end = text + len;
+  for (size_t i = 0; i < len; i += 8) {
+    uint64_t word = 0;
+    if (len - i >= 8) {
+      memcpy(&word, text + i, sizeof(word));
+    } else {
+      memcpy(&word, text + i, len - i);
+    }
+
+    uint64_t hits = _bytes_equal(word, '!') | _bytes_equal(word, '@');
+    while (hits) {
+      const char *p = text + i + __builtin_ctzll(hits) / 8;
+      hits &= hits - 1;
+      if (*p == '!' || *p == '@') { // A borrow can flag a byte above a hit
+        _token(text, p, end, priority, due);
+      }
+    }
+  }
+}
+
+// Extract the metadata columns of the tasks of table
+bool meta_extract(const struct Document *doc, const struct TodoTable *table,
+                  struct TaskMeta *meta) {
+  *meta = (struct TaskMeta){.count = table->count};
+  meta->priority = malloc(table->count + 1);
+  meta->due = malloc((table->count + 1) * sizeof(*meta->due));
+  if (!meta->priority || !meta->due) {
+    print_err("Memory allocation failed");
+    meta_free(meta);
+    return false;
+  }
+
+  for (size_t i = 0; i < table->count; i++) {
+    _extract(doc->data + table->offsets[i], table->lengths[i],
+             &meta->priority[i], &meta->due[i]);
+  }
+  return true;
+}
+
+// Release metadata columns
+void meta_free(struct TaskMeta *meta) {
+  free(meta->priority);
+  free(meta->due);
+  *meta = (struct TaskMeta){0};
+}
+
+// True if the task text of len bytes carries the tag "#tag"
+bool meta_has_tag(const char *text, size_t len, const char *tag,
+                  size_t tag_len) {
+  const char *end = text + len;
+  for (const char *p = memchr(text, '#', len); p;
+       p = memchr(p + 1, '#', end - p - 1)) {
+    if ((size_t)(end - p) > tag_len && _token_start(text, p) &&
+        memcmp(p + 1, tag, tag_len) == 0 && _token_end(p + 1, tag_len, end)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Shift one field of every task into keys, mapped so ascending order is
+// wanted. Reversed fields still list tasks without a value last.
+void _pack_field(uint64_t *keys, const struct TodoTable *table,
+                 const struct TaskMeta *meta, enum SortField field,
+                 bool descending) {
+  int bits = field_bits[field];
+  size_t n = table->count;
+  switch (field) {
+  case SORT_PRIORITY:
+    for (size_t i = 0; i < n; i++) {
+      uint64_t p = meta->priority[i];
+      p = descending && p != META_NO_PRIORITY ? 9 - p : p;
+      keys[i] = (keys[i] << bits) | p;
+    }
+    break;
+  case SORT_DUE:
+    for (size_t i = 0; i < n; i++) {
+      uint64_t due = meta->due[i];
+      due = descending && due != META_NO_DUE ? META_NO_DUE - 1 - due : due;
+      keys[i] = (keys[i] << bits) | due;
+    }
+    break;
+  case SORT_STATUS:
+    for (size_t i = 0; i < n; i++) {
+      keys[i] = (keys[i] << bits) | (bitmap_get(table->done, i) ^ descending);
+    }
+    break;
+  case SORT_ID: // Follows from the position, see meta_sort
+    break;
+  }
+}
+
+// Sort items by bits [32, 32 + bits), least significant digit first, the
+// low half rides along. Digits equal in every item are skipped.
+bool _radix_sort(uint64_t *items, size_t n, int bits) {
+  // All histograms come from one read of the items
+  int passes = (bits + RADIX_BITS - 1) / RADIX_BITS;
+  size_t (*counts)[RADIX_BUCKETS] = calloc(passes, sizeof(*counts));
+  uint64_t *tmp = malloc(n * sizeof(*tmp));
+  if (!counts || !tmp) {
+    free(counts);
+    free(tmp);
+    return false;
+  }
+  for (size_t i = 0; i < n; i++) {
+    uint64_t key = items[i] >> 32;
+    for (int pass = 0; pass < passes; pass++) {
+      counts[pass][key & (RADIX_BUCKETS - 1)]++;
+      key >>= RADIX_BITS;
+    }
+  }
+
+  uint64_t *src = items, *dst = tmp;
+  for (int pass = 0; pass < passes; pass++) {
+    size_t *count = counts[pass];
+    int shift = 32 + pass * RADIX_BITS;
+    if (count[(src[0] >> shift) & (RADIX_BUCKETS - 1)] == n) {
+      continue;
+    }
+
+    size_t offset = 0;
+    for (int b = 0; b < RADIX_BUCKETS; b++) {
+      size_t c = count[b];
+      count[b] = offset;
+      offset += c;
+    }
+    for (size_t i = 0; i < n; i++) {
+      dst[count[(src[i] >> shift) & (RADIX_BUCKETS - 1)]++] = src[i];
+    }
+
+    uint64_t *swap = src;
+    src = dst;
+    dst = swap;
+  }
+
+  if (src != items) {
+    memcpy(items, src, n * sizeof(*items));
+  }
+  free(counts);
+  free(tmp);
+  return true;
+}
+
+// Fill order with the positions of the tasks of table sorted by spec,
+// ties keep file order
+bool meta_sort(const struct TodoTable *table, const struct TaskMeta *meta,
+               const struct SortSpec *spec, uint32_t *order) {
+  size_t n = table->count;
+
+  // Every field gets a fixed slice of the top half of one integer, the
+  // first field the top bits. IDs grow with the position, so the stable
+  // sort orders by ID once the position sits in the bottom half. The keys
+  // after an ID never matter.
+  int bits = 0;
+  for (size_t k = 0; k < spec->count && spec->fields[k] != SORT_ID; k++) {
+    bits += field_bits[spec->fields[k]];
+  }
+  if (bits > 32) {
+    print_err("Too many sort keys.");
+    return false;
+  }
+
+  uint64_t *items = calloc(n + 1, sizeof(*items));
+  if (!items) {
+    print_err("Memory allocation failed");
+    return false;
+  }
+  bool reversed = false;
+  for (size_t k = 0; k < spec->count && spec->fields[k] != SORT_ID; k++) {
+    _pack_field(items, table, meta, spec->fields[k], spec->descending[k]);
+  }
+  for (size_t k = 0; k < spec->count; k++) {
+    if (spec->fields[k] == SORT_ID) {
+      reversed = spec->descending[k];
+      break;
+    }
+  }
+
+  // Descending IDs go in last task first, the sort keeps that order
+  for (size_t j = 0; reversed && j < n / 2; j++) {
+    uint64_t swap = items[j];
+    items[j] = items[n - 1 - j];
+    items[n - 1 - j] = swap;
+  }
+  for (size_t j = 0; j < n; j++) {
+    items[j] = (items[j] << 32) | (reversed ? n - 1 - j : j);
+  }
+
+  bool ok = _radix_sort(items, n, bits);
+  if (!ok) {
+    print_err("Memory allocation failed");
+  }
+  for (size_t j = 0; ok && j < n; j++) {
+    order[j] = (uint32_t)items[j];
+  }
+  free(items);
+  return ok;
+}
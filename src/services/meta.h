@@ -0,0 +1,86 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2025 Võ Quang Chiến
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef META_H
+#define META_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "storage.h"
+
+// Inline metadata is written in the task text: "!p1" for a priority from 0
+// (most urgent) to 9, "@due(2026-11-01)" for a due date and "#backend" for
+// a tag. Columns are only extracted when a command needs them, plain
+// listing never pays for it.
+
+#define META_NO_PRIORITY 15 // Sorts after every priority
+#define META_NO_DUE 0xfffff // Sorts after every date
+
+// Typed metadata columns, parallel to the tasks of a table
+struct TaskMeta {
+  uint8_t *priority; // 0-9, META_NO_PRIORITY without one
+  uint32_t *due;     // Days since 1970-01-01, META_NO_DUE without one
+  size_t count;
+};
+
+// What tasks can be sorted by
+enum SortField {
+  SORT_PRIORITY,
+  SORT_DUE,
+  SORT_STATUS, // Open tasks first
+  SORT_ID,
+};
+
+#define SORT_MAX_KEYS 4
+
+// Sort keys, most significant first
+struct SortSpec {
+  enum SortField fields[SORT_MAX_KEYS];
+  bool descending[SORT_MAX_KEYS];
+  size_t count;
+};
+
+// Parse comma separated sort keys (priority, due, status, id), a leading
+// "-" reverses one
+bool parse_sort(const char *text, struct SortSpec *spec);
+
+// Extract the metadata columns of the tasks of table
+bool meta_extract(const struct Document *doc, const struct TodoTable *table,
+                  struct TaskMeta *meta);
+
+// Release metadata columns
+void meta_free(struct TaskMeta *meta);
+
+// True if the task text of len bytes carries the tag "#tag"
+bool meta_has_tag(const char *text, size_t len, const char *tag,
+                  size_t tag_len);
+
+// Fill order with the positions of the tasks of table sorted by spec,
+// ties keep file order
+bool meta_sort(const struct TodoTable *table, const struct TaskMeta *meta,
+               const struct SortSpec *spec, uint32_t *order);
+
+#endif
@@ -0,0 +1,121 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2025 Võ Quang Chiến
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "pieces.h"
+
+#include <stdlib.h>
+
+#include "../utils/fmt.h"
+
+// Start an empty edit set over doc, whose bytes are also in fd unless it
+// is -1
+void pieces_init(struct PieceTable *pt, const struct Document *doc, int fd) {
+  *pt = (struct PieceTable){
+      .original = doc->data, .size = doc->size, .fd = fd};
+}
+
+// Append one piece
+bool _push_piece(struct PieceTable *pt, const char *data, size_t offset,
+                 size_t length) {
+  if (length == 0) {
+    return true;
+  }
+  if (pt->count == pt->capacity) {
+    size_t capacity = pt->capacity ? pt->capacity * 2 : 64;
+    struct Piece *pieces = realloc(pt->pieces, capacity * sizeof(*pieces));
+    if (!pieces) {
+      print_err("Memory allocation failed");
+      return false;
+    }
+    pt->pieces = pieces;
+    pt->capacity = capacity;
+  }
+
+  pt->pieces[pt->count++] =
+      (struct Piece){.data = data, .offset = offset, .length = length};
+  pt->length += length;
+  return true;
+}
+
+// Replace [offset, offset + length) of the original with len bytes of data,
+// which must stay valid until the table is written. offset may not be
+// before the end of the previous edit.
+bool pieces_replace(struct PieceTable *pt, size_t offset, size_t length,
+                    const char *data, size_t len) {
+  if (offset < pt->pos || offset + length > pt->size) {
+    print_err("Edits out of order");
+    return false;
+  }
+
+  if (!_push_piece(pt, NULL, pt->pos, offset - pt->pos) ||
+      !_push_piece(pt, data, 0, len)) {
+    return false;
+  }
+  pt->pos = offset + length;
+  return true;
+}
+
+// Size of the new document
+size_t pieces_size(const struct PieceTable *pt) {
+  return pt->length + (pt->size - pt->pos);
+}
+
+// Last byte of the new document, a newline if it is empty
+char pieces_last(const struct PieceTable *pt) {
+  if (pt->pos < pt->size) {
+    return pt->original[pt->size - 1];
+  }
+  if (pt->count == 0) {
+    return '\n';
+  }
+
+  const struct Piece *last = &pt->pieces[pt->count - 1];
+  return last->data ? last->data[last->length - 1]
+                    : pt->original[last->offset + last->length - 1];
+}
+
+// Write one span of the original
+bool _write_original(const struct PieceTable *pt, struct Writer *w,
+                     size_t offset, size_t length) {
+  return pt->fd >= 0 ? writer_copy(w, pt->fd, offset, length)
+                     : writer_write(w, pt->original + offset, length);
+}
+
+// Write the new document, original spans are copied inside the kernel
+bool pieces_write(const struct PieceTable *pt, struct Writer *w) {
+  bool ok = true;
+  for (size_t i = 0; ok && i < pt->count; i++) {
+    const struct Piece *p = &pt->pieces[i];
+    ok = p->data ? writer_write(w, p->data, p->length)
+                 : _write_original(pt, w, p->offset, p->length);
+  }
+  return ok && _write_original(pt, w, pt->pos, pt->size - pt->pos);
+}
+
+// Release the edit set
+void pieces_free(struct PieceTable *pt) {
+  free(pt->pieces);
+  pt->pieces = NULL;
+  pt->count = pt->capacity = 0;
+}
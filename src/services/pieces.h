@@ -0,0 +1,78 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2025 Võ Quang Chiến
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef PIECES_H
+#define PIECES_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "storage.h"
+#include "writer.h"
+
+// A span of the new document, taken from the original or from memory
+struct Piece {
+  const char *data; // NULL for a span of the original
+  size_t offset;    // Start in the original when data is NULL
+  size_t length;
+};
+
+// Piece table over the bytes of a document. Edits replace spans of the
+// original in file order, and saving writes the untouched spans around
+// them as they are, so nothing the parser does not understand is lost and
+// the work done is proportional to the edits.
+struct PieceTable {
+  const char *original;
+  size_t size;
+  int fd;     // File holding the original, -1 if it only lives in memory
+  size_t pos; // End of the last edit in the original
+  struct Piece *pieces;
+  size_t count;
+  size_t capacity;
+  size_t length; // Bytes of the new document up to pos
+};
+
+// Start an empty edit set over doc, whose bytes are also in fd unless it
+// is -1
+void pieces_init(struct PieceTable *pt, const struct Document *doc, int fd);
+
+// Replace [offset, offset + length) of the original with len bytes of data,
+// which must stay valid until the table is written. offset may not be
+// before the end of the previous edit.
+bool pieces_replace(struct PieceTable *pt, size_t offset, size_t length,
+                    const char *data, size_t len);
+
+// Size of the new document
+size_t pieces_size(const struct PieceTable *pt);
+
+// Last byte of the new document, a newline if it is empty
+char pieces_last(const struct PieceTable *pt);
+
+// Write the new document, original spans are copied inside the kernel
+bool pieces_write(const struct PieceTable *pt, struct Writer *w);
+
+// Release the edit set
+void pieces_free(struct PieceTable *pt);
+
+#endif
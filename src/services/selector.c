@@ -0,0 +1,231 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2025 Võ Quang Chiến
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "selector.h"
+
+#include <ctype.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../utils/bitmap.h"
+#include "../utils/fmt.h"
+
+// Parse a task ID, move *text past it
+bool _parse_id(const char **text, uint32_t *out) {
+  if (!isdigit((unsigned char)**text)) {
+    return false;
+  }
+
+  char *end;
+  errno = 0;
+  unsigned long value = strtoul(*text, &end, 10);
+  if (errno != 0 || value > UINT32_MAX) {
+    return false;
+  }
+  *text = end;
+  *out = value;
+  return true;
+}
+
+// Append a range to the selector
+bool _push_range(struct Selector *sel, uint32_t first, uint32_t last,
+                 size_t *capacity) {
+  if (sel->count == *capacity) {
+    *capacity = *capacity ? *capacity * 2 : 8;
+    struct SelectorRange *ranges =
+        realloc(sel->ranges, *capacity * sizeof(*ranges));
+    if (!ranges) {
+      return false;
+    }
+    sel->ranges = ranges;
+  }
+  sel->ranges[sel->count++] = (struct SelectorRange){first, last};
+  return true;
+}
+
+// Parse a comma separated list of IDs, ranges (a-b, a-) and the keywords
+// all, done and open
+bool selector_parse(struct Selector *sel, const char *text) {
+  *sel = (struct Selector){0};
+  size_t capacity = 0;
+
+  while (true) {
+    size_t len = strcspn(text, ",");
+
+    if (len == 0) { // Consecutive commas or empty item
+      print_err("Invalid syntax (empty item between commas).");
+      selector_free(sel);
+      return false;
+    }
+
+    if (len == 3 && strncmp(text, "all", len) == 0) {
+      sel->all = true;
+    } else if (len == 4 && strncmp(text, "done", len) == 0) {
+      sel->done = true;
+    } else if (len == 4 && strncmp(text, "open", len) == 0) {
+      sel->open = true;
+    } else {
+      const char *p = text;
+      uint32_t first, last;
+
+      if (!_parse_id(&p, &first)) {
+        print_err("Invalid ID or keyword in argument.");
+        selector_free(sel);
+        return false;
+      }
+      last = first;
+
+      if (*p == '-') {
+        p++;
+        last = UINT32_MAX; // "a-" runs to the last task
+        if (p != text + len && !_parse_id(&p, &last)) {
+          print_err("Invalid range in argument.");
+          selector_free(sel);
+          return false;
+        }
+      }
+
+      if (p != text + len || last < first) {
+        print_err("Invalid range in argument.");
+        selector_free(sel);
+        return false;
+      }
+
+      if (!_push_range(sel, first, last, &capacity)) {
+        print_err("Memory allocation failed");
+        selector_free(sel);
+        return false;
+      }
+    }
+
+    if (text[len] == '\0') {
+      return true;
+    }
+    text += len + 1;
+  }
+}
+
+// Selector for the single task id
+bool selector_id(struct Selector *sel, uint32_t id) {
+  *sel = (struct Selector){0};
+  size_t capacity = 0;
+  return _push_range(sel, id, id, &capacity);
+}
+
+// Text that selector_parse turns back into sel, caller frees it
+char *selector_format(const struct Selector *sel) {
+  // "4294967295-4294967295," is the longest item
+  size_t size = sel->count * 22 + sizeof("all,done,open");
+  char *text = malloc(size);
+  if (!text) {
+    return NULL;
+  }
+
+  size_t len = 0;
+  for (size_t i = 0; i < sel->count; i++) {
+    struct SelectorRange r = sel->ranges[i];
+    if (r.first == r.last) {
+      len += snprintf(text + len, size - len, "%u,", r.first);
+    } else if (r.last == UINT32_MAX) {
+      len += snprintf(text + len, size - len, "%u-,", r.first);
+    } else {
+      len += snprintf(text + len, size - len, "%u-%u,", r.first, r.last);
+    }
+  }
+  len += snprintf(text + len, size - len, "%s%s%s", sel->all ? "all," : "",
+                  sel->done ? "done," : "", sel->open ? "open," : "");
+
+  text[len > 0 ? len - 1 : 0] = '\0'; // Drop the trailing comma
+  return text;
+}
+
+// Release a parsed selector
+void selector_free(struct Selector *sel) {
+  free(sel->ranges);
+  *sel = (struct Selector){0};
+}
+
+// True if matching needs the status of the tasks
+bool selector_needs_status(const struct Selector *sel) {
+  return !sel->all && (sel->done || sel->open);
+}
+
+// Highest ID the selector can match, 0 if it can match any task
+uint32_t selector_limit(const struct Selector *sel) {
+  if (sel->all || sel->done || sel->open) {
+    return 0;
+  }
+
+  uint32_t limit = 0;
+  for (size_t i = 0; i < sel->count; i++) {
+    if (sel->ranges[i].last == UINT32_MAX) {
+      return 0;
+    }
+    if (sel->ranges[i].last > limit) {
+      limit = sel->ranges[i].last;
+    }
+  }
+  return limit;
+}
+
+// Set the bit of every matching task position in out, which holds
+// BITMAP_WORDS(count) zeroed words. done is the status bitmap of the tasks
+// and may be NULL if the selector does not need it.
+void selector_match(const struct Selector *sel, size_t count,
+                    const uint64_t *done, uint64_t *out) {
+  size_t words = BITMAP_WORDS(count);
+
+  if (sel->all || (sel->done && sel->open)) {
+    bitmap_set_range(out, 0, count);
+    return;
+  }
+
+  // Status keywords work a word at a time
+  if (sel->done || sel->open) {
+    for (size_t w = 0; w < words; w++) {
+      out[w] = sel->done ? done[w] : ~done[w];
+    }
+    if (count % 64 != 0) { // Bits past the last task are garbage
+      out[words - 1] &= ((uint64_t)1 << (count % 64)) - 1;
+    }
+  }
+
+  // IDs start at 1, bit positions at 0
+  for (size_t i = 0; i < sel->count; i++) {
+    size_t first = sel->ranges[i].first;
+    size_t last = sel->ranges[i].last;
+    if (first == 0) {
+      first = 1;
+    }
+    if (last > count) {
+      last = count;
+    }
+    if (first <= last) {
+      bitmap_set_range(out, first - 1, last);
+    }
+  }
+}
@@ -0,0 +1,72 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2025 Võ Quang Chiến
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef SELECTOR_H
+#define SELECTOR_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// IDs first to last, both included
+struct SelectorRange {
+  uint32_t first;
+  uint32_t last;
+};
+
+// Which tasks a command applies to, e.g. "1,4-6,done"
+struct Selector {
+  struct SelectorRange *ranges;
+  size_t count;
+  bool all;  // Every task
+  bool done; // Every completed task
+  bool open; // Every task not completed yet
+};
+
+// Parse a comma separated list of IDs, ranges (a-b, a-) and the keywords
+// all, done and open
+bool selector_parse(struct Selector *sel, const char *text);
+
+// Selector for the single task id
+bool selector_id(struct Selector *sel, uint32_t id);
+
+// Text that selector_parse turns back into sel, caller frees it
+char *selector_format(const struct Selector *sel);
+
+// Release a parsed selector
+void selector_free(struct Selector *sel);
+
+// True if matching needs the status of the tasks
+bool selector_needs_status(const struct Selector *sel);
+
+// Highest ID the selector can match, 0 if it can match any task
+uint32_t selector_limit(const struct Selector *sel);
+
+// Set the bit of every matching task position in out, which holds
+// BITMAP_WORDS(count) zeroed words. done is the status bitmap of the tasks
+// and may be NULL if the selector does not need it.
+void selector_match(const struct Selector *sel, size_t count,
+                    const uint64_t *done, uint64_t *out);
+
+#endif
@@ -25,193 +25,1249 @@
 #include "storage.h"
 
 #include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <utlist.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 #include "../utils/fmt.h"
+#include "../utils/scan.h"
+#include "../utils/stats.h"
+#include "batch.h"
+#include "index.h"
+#include "journal.h"
+#include "lock.h"
+#include "pieces.h"
+#include "selector.h"
+#include "writer.h"
 
 // Constants
-#define BUFFER_SIZE 1024
 #define TODO_FORMAT "- [%c] %s\n"
+#define TODO_HEADER                                                            \
+  "<!-- Modify if you want to update the content or uncheck ._. -->\n"
+#define PARSE_PARALLEL_MIN (32 * 1024 * 1024) // Parse in parallel from here
+#define PARSE_CHUNK_MIN (4 * 1024 * 1024)
+#define PARSE_MAX_THREADS 64
 
-// Initialize the TODO.md or other name if user wants
-bool init(const char *file_path, const char *title) {
-  FILE *file = fopen(file_path, "w");
-  if (!file) {
-    print_err(strerror(errno));
+// Parser threads requested with --threads, 0 for automatic
+static size_t parse_threads = 0;
+
+// Write a fresh document, the body of init
+bool _create(const char *file_path, const char *title,
+             enum Durability durability) {
+  struct Writer w;
+  if (!writer_open(&w, file_path, durability)) {
     return false;
   }
 
+  writer_puts(&w, TODO_HEADER);
   if (strlen(title) != 0) {
-    fprintf(file,
-            "<!-- Modify if you want to update the content or uncheck ._. "
-            "-->\n# %s\n\n",
-            title);
-  } else {
-    fprintf(
-        file,
-        "<!-- Modify if you want to update the content or uncheck ._. -->\n");
+    writer_puts(&w, "# ");
+    writer_puts(&w, title);
+    writer_puts(&w, "\n\n");
   }
 
-  fclose(file);
+  if (!writer_commit(&w)) {
+    return false;
+  }
+
+  if (index_exists(file_path)) {
+    build_index(file_path);
+  }
   return true;
 }
 
-// Get all todos, return the pointer to head of linked list
-struct TodoNode *list_todos(const char *file_path) {
-  FILE *file = fopen(file_path, "r");
-  if (!file) {
+// Initialize the TODO.md or other name if user wants
+bool init(const char *file_path, const char *title,
+          enum Durability durability) {
+  struct Lock lock;
+  if (!lock_acquire(&lock, file_path)) {
+    return false;
+  }
+  bool ok = _create(file_path, title, durability);
+  if (ok) { // Records of the old file mean nothing for the new one
+    journal_remove(file_path);
+  }
+  lock_release(&lock);
+  return ok;
+}
+
+// Map the file behind fd read-only into doc
+bool doc_map(struct Document *doc, int fd) {
+  doc->data = NULL;
+  doc->size = 0;
+
+  if (fstat(fd, &doc->st) != 0) {
     print_err(strerror(errno));
-    return NULL;
+    return false;
   }
 
-  struct TodoNode *res = NULL;
-  char buffer[BUFFER_SIZE];
-  int id = 0;
+  // mmap() refuses empty mappings, an empty file is just an empty view
+  if (doc->st.st_size > 0) {
+    void *data = mmap(NULL, doc->st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (data == MAP_FAILED) {
+      print_err(strerror(errno));
+      return false;
+    }
+    madvise(data, doc->st.st_size, MADV_SEQUENTIAL);
+    stats_add(STAT_BYTES_READ, doc->st.st_size);
+    doc->data = data;
+    doc->size = doc->st.st_size;
+  }
+  return true;
+}
 
-  while (fgets(buffer, sizeof(buffer), file)) {
-    buffer[strcspn(buffer, "\n")] = '\0'; // Remove newline if exists
+// Map file_path read-only into doc
+bool doc_open(struct Document *doc, const char *file_path) {
+  int fd = open(file_path, O_RDONLY);
+  if (fd < 0) {
+    print_err(strerror(errno));
+    return false;
+  }
+  stats_add(STAT_OPENS, 1);
 
-    struct TodoNode *new_node =
-        (struct TodoNode *)malloc(sizeof(struct TodoNode));
-    if (!new_node) {
-      print_err("Memory allocation failed");
-      fclose(file);
-      free_list(res);
-      return NULL;
+  bool ok = doc_map(doc, fd);
+  close(fd);
+  return ok;
+}
+
+// Unmap a document opened with doc_open
+void doc_close(struct Document *doc) {
+  if (doc->data) {
+    munmap(doc->data, doc->size);
+  }
+  doc->data = NULL;
+  doc->size = 0;
+}
+
+// Parse one line starting at offset line, fill todo if it is a task
+bool _parse_line(const char *data, size_t line, size_t end, Todo *todo) {
+  size_t i = line;
+  while (i < end && data[i] == ' ') { // Skip leading spaces
+    i++;
+  }
+
+  if (i >= end || data[i] != '-') { // Invalid format for todo in markdown
+    return false;
+  }
+
+  // Get status
+  i += 2;
+  if (i + 2 >= end || data[i] != '[' || data[i + 2] != ']') {
+    return false;
+  }
+  todo->is_done = (data[i + 1] != ' ');
+
+  i += 3;
+  while (i < end && data[i] == ' ') {
+    i++;
+  }
+
+  todo->line = line;
+  todo->offset = i;
+  todo->length = end - i;
+  return true;
+}
+
+// Offset of the status byte inside "- [ ]" for the task line at line
+size_t mark_offset(const char *data, size_t line) {
+  while (data[line] == ' ') {
+    line++;
+  }
+  return line + 3;
+}
+
+// Parse the line [line, end) and hand it to fn if it is a task
+static inline bool _visit_line(const char *data, size_t line, size_t end,
+                               uint32_t *id, todo_fn fn, void *ctx) {
+  // Most non-task lines are rejected on their first byte
+  if (line == end || (data[line] != '-' && data[line] != ' ')) {
+    return true;
+  }
+
+  Todo todo;
+  if (!_parse_line(data, line, end, &todo)) {
+    return true;
+  }
+  todo.id = ++*id;
+  return fn(&todo, ctx);
+}
+
+// Call fn for the tasks whose lines start in [begin, end), numbering them
+// from 1, stop early if fn returns false. begin must be a line start.
+void _scan_range(const char *data, size_t begin, size_t end, todo_fn fn,
+                 void *ctx) {
+  uint32_t id = 0;
+  size_t line = begin;
+  size_t newlines[SCAN_BATCH];
+
+  // Line ends come from the vector scanner a batch at a time
+  while (line < end) {
+    size_t n = find_newlines(data, line, end, newlines, SCAN_BATCH);
+
+    for (size_t k = 0; k < n; k++) {
+      if (!_visit_line(data, line, newlines[k], &id, fn, ctx)) {
+        return;
+      }
+      line = newlines[k] + 1;
     }
 
-    // Parse string
-    int i = 0;
-    while (buffer[i] == ' ') { // Skip leading spaces
-      i++;
+    if (n < SCAN_BATCH) {
+      if (line < end) {
+        _visit_line(data, line, end, &id, fn, ctx);
+      }
+      return;
     }
+  }
+}
+
+// Call fn for every task in doc in file order, stop early if fn returns false
+void scan_todos(const struct Document *doc, todo_fn fn, void *ctx) {
+  _scan_range(doc->data, 0, doc->size, fn, ctx);
+}
+
+// Call fn for the tasks whose lines start in [begin, end) of doc, numbered
+// from 1. begin must be a line start.
+void scan_range(const struct Document *doc, size_t begin, size_t end,
+                todo_fn fn, void *ctx) {
+  _scan_range(doc->data, begin, end, fn, ctx);
+}
+
+// Grow every column of the table to hold capacity tasks
+bool _table_reserve(struct TodoTable *table, size_t capacity) {
+  struct Arena *arena = &table->arena;
+
+  uint32_t *ids = arena_alloc(arena, capacity * sizeof(*ids));
+  uint64_t *done = arena_alloc(arena, BITMAP_WORDS(capacity) * sizeof(*done));
+  size_t *lines = arena_alloc(arena, capacity * sizeof(*lines));
+  size_t *offsets = arena_alloc(arena, capacity * sizeof(*offsets));
+  uint32_t *lengths = arena_alloc(arena, capacity * sizeof(*lengths));
+  if (!ids || !done || !lines || !offsets || !lengths) {
+    return false;
+  }
+
+  // Old columns stay in the arena until the table is freed
+  size_t n = table->count;
+  if (n > 0) {
+    memcpy(ids, table->ids, n * sizeof(*ids));
+    memcpy(done, table->done, BITMAP_WORDS(n) * sizeof(*done));
+    memcpy(lines, table->lines, n * sizeof(*lines));
+    memcpy(offsets, table->offsets, n * sizeof(*offsets));
+    memcpy(lengths, table->lengths, n * sizeof(*lengths));
+  }
+  memset(done + BITMAP_WORDS(n), 0,
+         (BITMAP_WORDS(capacity) - BITMAP_WORDS(n)) * sizeof(*done));
+
+  table->ids = ids;
+  table->done = done;
+  table->lines = lines;
+  table->offsets = offsets;
+  table->lengths = lengths;
+  table->capacity = capacity;
+  return true;
+}
 
-    if (buffer[i] != '-') { // Invalid format for todo in markdown
-      free(new_node);
+// Grow every column of the table to hold at least one more task
+bool _table_grow(struct TodoTable *table) {
+  return _table_reserve(table, table->capacity ? table->capacity * 2 : 64);
+}
+
+// Append one task to the table
+bool table_push(struct TodoTable *table, const Todo *todo) {
+  if (table->count == table->capacity && !_table_grow(table)) {
+    print_err("Memory allocation failed");
+    return false;
+  }
+
+  size_t i = table->count++;
+  table->ids[i] = todo->id;
+  bitmap_put(table->done, i, todo->is_done);
+  table->lines[i] = todo->line;
+  table->offsets[i] = todo->offset;
+  table->lengths[i] = (uint32_t)todo->length;
+  return true;
+}
+
+// Read task i back from the table
+Todo table_get(const struct TodoTable *table, size_t i) {
+  return (Todo){
+      .id = table->ids[i],
+      .line = table->lines[i],
+      .offset = table->offsets[i],
+      .length = table->lengths[i],
+      .is_done = bitmap_get(table->done, i),
+  };
+}
+
+// Drop every task whose bit is set in drop, keeping the order of the rest
+void table_compact(struct TodoTable *table, const uint64_t *drop) {
+  size_t kept = 0;
+  for (size_t i = 0; i < table->count; i++) {
+    if (bitmap_get(drop, i)) {
       continue;
     }
+    table->ids[kept] = table->ids[i];
+    bitmap_put(table->done, kept, bitmap_get(table->done, i));
+    table->lines[kept] = table->lines[i];
+    table->offsets[kept] = table->offsets[i];
+    table->lengths[kept] = table->lengths[i];
+    kept++;
+  }
+  table->count = kept;
+}
 
-    // Get status
-    i += 2;
-    if (buffer[i] != '[') {
-      free(new_node);
-      continue;
+// Table being filled by scan_todos
+struct _TableBuilder {
+  struct TodoTable *table;
+  uint32_t limit; // Stop after this ID, 0 for no limit
+  bool failed;
+};
+
+// Append one parsed task to the table in ctx
+bool _push_todo(const Todo *todo, void *ctx) {
+  struct _TableBuilder *builder = ctx;
+  if (!table_push(builder->table, todo)) {
+    builder->failed = true;
+    return false;
+  }
+  return todo->id != builder->limit;
+}
+
+// Get the todos of doc up to ID limit (0 for all) into an empty table
+bool _list_until(const struct Document *doc, struct TodoTable *table,
+                 uint32_t limit) {
+  *table = (struct TodoTable){0};
+
+  struct _TableBuilder builder = {.table = table, .limit = limit};
+  scan_todos(doc, _push_todo, &builder);
+  if (builder.failed) {
+    free_table(table);
+    return false;
+  }
+  return true;
+}
+
+// One slice of the document parsed by a worker thread
+struct _Chunk {
+  const char *data;
+  size_t begin;
+  size_t end;
+  struct TodoTable table; // Tasks of the slice, IDs local to it
+  struct TodoTable *out;  // Merged table
+  size_t base;            // Tasks in all earlier chunks
+  bool failed;
+};
+
+// Parse one chunk into its own table
+void *_parse_chunk(void *arg) {
+  struct _Chunk *chunk = arg;
+  struct _TableBuilder builder = {.table = &chunk->table};
+  _scan_range(chunk->data, chunk->begin, chunk->end, _push_todo, &builder);
+  chunk->failed = builder.failed;
+  return NULL;
+}
+
+// Copy a parsed chunk into its slot of the merged table
+void *_merge_chunk(void *arg) {
+  struct _Chunk *chunk = arg;
+  const struct TodoTable *src = &chunk->table;
+  struct TodoTable *out = chunk->out;
+  size_t base = chunk->base;
+
+  for (size_t i = 0; i < src->count; i++) {
+    out->ids[base + i] = src->ids[i] + base;
+  }
+  memcpy(out->lines + base, src->lines, src->count * sizeof(*src->lines));
+  memcpy(out->offsets + base, src->offsets,
+         src->count * sizeof(*src->offsets));
+  memcpy(out->lengths + base, src->lengths,
+         src->count * sizeof(*src->lengths));
+  return NULL;
+}
+
+// Run fn over every chunk, one thread per chunk
+bool _run_chunks(struct _Chunk *chunks, size_t n, void *(*fn)(void *)) {
+  pthread_t threads[PARSE_MAX_THREADS];
+  size_t started = 0;
+
+  // The calling thread takes the first chunk itself
+  for (size_t k = 1; k < n; k++) {
+    if (pthread_create(&threads[k], NULL, fn, &chunks[k]) != 0) {
+      break;
     }
-    i++;
-    new_node->todo.is_done = (buffer[i] != ' ');
-    i++;
-    if (buffer[i] != ']') {
-      free(new_node);
-      continue;
+    started = k;
+  }
+  fn(&chunks[0]);
+  for (size_t k = started + 1; k < n; k++) {
+    fn(&chunks[k]); // Could not get a thread, do it here
+  }
+  for (size_t k = 1; k <= started; k++) {
+    pthread_join(threads[k], NULL);
+  }
+  return true;
+}
+
+// Number of parser threads for a document of size bytes
+size_t _parse_threads(size_t size) {
+  size_t threads = parse_threads;
+  if (threads == 0) {
+    if (size < PARSE_PARALLEL_MIN) {
+      return 1;
     }
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    threads = cpus > 0 ? (size_t)cpus : 1;
+  }
 
-    i++;
-    while (buffer[i] == ' ') {
-      i++;
+  // Tiny chunks cost more in thread startup than they save
+  size_t by_size = size / PARSE_CHUNK_MIN + 1;
+  if (threads > by_size) {
+    threads = by_size;
+  }
+  return threads < PARSE_MAX_THREADS ? threads : PARSE_MAX_THREADS;
+}
+
+// Parse newline-aligned chunks in parallel and merge them in file order,
+// IDs are offset by a prefix sum of the per-chunk task counts
+bool _list_parallel(const struct Document *doc, struct TodoTable *table,
+                    size_t threads) {
+  struct _Chunk chunks[PARSE_MAX_THREADS] = {0};
+  size_t n = 0;
+  size_t begin = 0;
+
+  for (size_t k = 0; k < threads && begin < doc->size; k++) {
+    size_t end = doc->size * (k + 1) / threads;
+    if (end < begin) {
+      end = begin;
     }
-    strncpy(new_node->todo.content, buffer + i,
-            sizeof(new_node->todo.content) - 1);
-    new_node->todo.content[sizeof(new_node->todo.content) - 1] =
-        '\0'; // Ensure null-termination
-    new_node->todo.id = ++id;
+    // Move the cut just past the next newline so no line is split
+    const char *nl = memchr(doc->data + end, '\n', doc->size - end);
+    end = (k == threads - 1 || !nl) ? doc->size : (size_t)(nl - doc->data) + 1;
 
-    DL_APPEND(res, new_node);
+    chunks[n++] = (struct _Chunk){
+        .data = doc->data, .begin = begin, .end = end, .out = table};
+    begin = end;
   }
 
-  fclose(file);
-  return res;
+  _run_chunks(chunks, n, _parse_chunk);
+
+  size_t total = 0;
+  bool ok = true;
+  for (size_t k = 0; k < n; k++) {
+    ok = ok && !chunks[k].failed;
+    chunks[k].base = total;
+    total += chunks[k].table.count;
+  }
+
+  if (ok && total > 0 && !_table_reserve(table, total)) {
+    print_err("Memory allocation failed");
+    ok = false;
+  }
+
+  if (ok) {
+    table->count = total;
+    _run_chunks(chunks, n, _merge_chunk);
+
+    // Chunks rarely start on a word boundary, merge the bitmap here
+    for (size_t k = 0; k < n; k++) {
+      for (size_t i = 0; i < chunks[k].table.count; i++) {
+        if (bitmap_get(chunks[k].table.done, i)) {
+          bitmap_set(table->done, chunks[k].base + i);
+        }
+      }
+    }
+  }
+
+  for (size_t k = 0; k < n; k++) {
+    free_table(&chunks[k].table);
+  }
+  if (!ok) {
+    free_table(table);
+  }
+  return ok;
 }
 
-// Release memory of todo list
-void free_list(struct TodoNode *head) {
-  struct TodoNode *elt, *tmp;
-  DL_FOREACH_SAFE(head, elt, tmp) { free(elt); }
+// Get all todos of doc into an empty table
+bool list_todos(const struct Document *doc, struct TodoTable *table) {
+  size_t span = stats_begin("parse");
+  size_t threads = _parse_threads(doc->size);
+  bool ok;
+  if (threads > 1) {
+    *table = (struct TodoTable){0};
+    ok = _list_parallel(doc, table, threads);
+  } else {
+    ok = _list_until(doc, table, 0);
+  }
+  stats_end(span);
+  return ok;
 }
 
-// Check if the file exists
-bool _file_exist(const char *file_path) {
-  FILE *file = fopen(file_path, "r");
-  if (file) {
-    fclose(file);
+// Use threads parser threads, 0 picks a count from the document size
+void set_parse_threads(size_t threads) { parse_threads = threads; }
+
+// Release memory of todo table
+void free_table(struct TodoTable *table) {
+  arena_free(&table->arena);
+  *table = (struct TodoTable){0};
+}
+
+// Fill an empty table from a valid index without parsing the document
+bool _table_from_index(const struct Index *idx, struct TodoTable *table) {
+  *table = (struct TodoTable){0};
+
+  for (size_t i = 0; i < idx->count; i++) {
+    const struct IndexEntry *e = &idx->entries[i];
+    Todo todo = {
+        .id = i + 1,
+        .line = e->line,
+        .offset = e->line + e->content,
+        .length = e->length - e->content,
+        .is_done = e->flags & INDEX_DONE,
+    };
+    if (!table_push(table, &todo)) {
+      free_table(table);
+      return false;
+    }
+  }
+  return true;
+}
+
+// Index entries describing the tasks of table, caller frees them
+struct IndexEntry *index_entries(const struct Document *doc,
+                                 const struct TodoTable *table) {
+  struct IndexEntry *entries =
+      malloc((table->count + 1) * sizeof(struct IndexEntry));
+  if (!entries) {
+    return NULL;
+  }
+
+  for (size_t i = 0; i < table->count; i++) {
+    size_t line = table->lines[i];
+    size_t content = table->offsets[i] - line;
+    size_t mark = mark_offset(doc->data, line) - line;
+
+    // Absurdly indented lines do not fit an entry, go without an index
+    if (content > UINT16_MAX || mark > UINT8_MAX) {
+      free(entries);
+      return NULL;
+    }
+
+    entries[i] = (struct IndexEntry){
+        .line = line,
+        .length = content + table->lengths[i],
+        .content = content,
+        .mark = mark,
+        .flags = bitmap_get(table->done, i) ? INDEX_DONE : 0,
+    };
+  }
+  return entries;
+}
+
+// Write the sidecar index of doc from its parsed tasks, stamped with the
+// identity of the version that was parsed. Call as the writer of file_path.
+bool _write_index(const char *file_path, const struct Document *doc,
+                  const struct TodoTable *table) {
+  struct IndexEntry *entries = index_entries(doc, table);
+  if (!entries) {
+    return false;
+  }
+
+  bool ok = index_write(file_path, &doc->st, entries, table->count);
+  free(entries);
+  return ok;
+}
+
+// True if table, parsed from doc, still describes file_path. Call as the
+// writer of file_path.
+bool _parse_current(const char *file_path, const struct Document *doc,
+                    const struct TodoTable *table) {
+  struct stat st;
+  if (stat(file_path, &st) != 0 || st.st_size != doc->st.st_size ||
+      st.st_mtim.tv_sec != doc->st.st_mtim.tv_sec ||
+      st.st_mtim.tv_nsec != doc->st.st_mtim.tv_nsec ||
+      st.st_ino != doc->st.st_ino || st.st_dev != doc->st.st_dev) {
+    return false;
+  }
+
+  // done and undone patch the file in place and can land within one mtime
+  // tick, so the status bytes are compared too. The read-only mapping
+  // shows the page cache, writes made since the parse included.
+  for (size_t i = 0; i < table->count; i++) {
+    bool done = doc->data[mark_offset(doc->data, table->lines[i])] != ' ';
+    if (done != bitmap_get(table->done, i)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Replace the stale index of file_path with one built from the parse of
+// doc. Skipped while a writer is in or once the file moved on from doc.
+bool _refresh_index_from(const char *file_path, const struct Document *doc,
+                         const struct TodoTable *table) {
+  struct Lock lock;
+  if (!lock_try(&lock, file_path)) {
+    return false;
+  }
+  bool ok = _parse_current(file_path, doc, table) &&
+            _write_index(file_path, doc, table);
+  lock_release(&lock);
+  return ok;
+}
+
+// Parse file_path and write a fresh sidecar index for it, as its writer
+bool build_index(const char *file_path) {
+  struct Document doc;
+  if (!doc_open(&doc, file_path)) {
+    return false;
+  }
+
+  struct TodoTable todos;
+  bool ok = list_todos(&doc, &todos);
+  if (ok) {
+    ok = _write_index(file_path, &doc, &todos);
+    free_table(&todos);
+  }
+
+  doc_close(&doc);
+  return ok;
+}
+
+// Make sure file_path has an up to date sidecar index
+bool refresh_index(const char *file_path) {
+  struct stat st;
+  if (stat(file_path, &st) != 0) {
+    print_err(strerror(errno));
+    return false;
+  }
+
+  struct Index idx;
+  if (index_open(&idx, file_path, &st)) {
+    index_close(&idx);
     return true;
   }
-  return false;
+
+  struct Document doc;
+  if (!doc_open(&doc, file_path)) {
+    return false;
+  }
+  struct TodoTable todos;
+  bool ok = list_todos(&doc, &todos);
+  if (ok) {
+    ok = _refresh_index_from(file_path, &doc, &todos);
+    free_table(&todos);
+  }
+  doc_close(&doc);
+  return ok;
+}
+
+// Get all todos of doc, through its sidecar index when it is up to date
+bool load_todos(const struct Document *doc, const char *file_path,
+                struct TodoTable *table) {
+  struct Index idx;
+  if (index_open(&idx, file_path, &doc->st)) {
+    size_t span = stats_begin("index");
+    bool ok = _table_from_index(&idx, table);
+    index_close(&idx);
+    stats_end(span);
+    return ok;
+  }
+
+  if (!list_todos(doc, table)) {
+    return false;
+  }
+
+  // A stale index is rebuilt from the parse we just did. A replayed
+  // journal is not the file itself and never passes the check.
+  if (index_exists(file_path)) {
+    _refresh_index_from(file_path, doc, table);
+  }
+  return true;
 }
 
-// Ensure the file ends with a newline
-void _ensure_newline(FILE *file) {
-  fseek(file, -1, SEEK_END);
+// Count the todos of file_path, from the index header when possible
+bool count_todos(const char *file_path, size_t *count) {
+  // Pending journal records change the count, the index cannot know them
+  if (journal_size(file_path) > 0) {
+    struct Batch b;
+    if (!batch_open(&b, file_path)) {
+      return false;
+    }
+    *count = batch_count(&b);
+    batch_close(&b);
+    return true;
+  }
+
+  struct stat st;
+  struct Index idx;
+  if (stat(file_path, &st) == 0 && index_open(&idx, file_path, &st)) {
+    *count = idx.count;
+    index_close(&idx);
+    return true;
+  }
+
+  struct Document doc;
+  if (!doc_open(&doc, file_path)) {
+    return false;
+  }
+
+  struct TodoTable todos;
+  bool ok = load_todos(&doc, file_path, &todos);
+  if (ok) {
+    *count = todos.count;
+    free_table(&todos);
+  }
+  doc_close(&doc);
+  return ok;
+}
+
+// Window of tasks handed to a caller's callback
+struct _Window {
+  size_t base; // Tasks before the scan start
+  size_t skip; // Tasks still to skip
+  size_t left; // Tasks still to emit, SIZE_MAX for no limit
+  todo_fn fn;
+  void *ctx;
+};
+
+// Renumber the task, then skip or emit it, stop once the window is done
+bool _window_todo(const Todo *todo, void *ctx) {
+  struct _Window *w = ctx;
+  if (w->skip > 0) {
+    w->skip--;
+    return true;
+  }
+
+  Todo shifted = *todo;
+  shifted.id += w->base;
+  if (!w->fn(&shifted, w->ctx)) {
+    return false;
+  }
+  return --w->left > 0;
+}
+
+// Call fn for the tasks with IDs in (skip, skip + limit], limit 0 meaning no
+// limit. Parsing stops as soon as the window is done, and with an up to
+// date index it starts right at the first wanted task.
+void window_todos(const struct Document *doc, const char *file_path,
+                  size_t skip, size_t limit, todo_fn fn, void *ctx) {
+  struct _Window w = {.skip = skip,
+                      .left = limit ? limit : SIZE_MAX,
+                      .fn = fn,
+                      .ctx = ctx};
+  size_t begin = 0;
+
+  struct Index idx;
+  if (skip > 0 && index_open(&idx, file_path, &doc->st)) {
+    if (skip >= idx.count) {
+      index_close(&idx);
+      return;
+    }
+    begin = idx.entries[skip].line;
+    w.base = skip;
+    w.skip = 0;
+    index_close(&idx);
+  }
+
+  _scan_range(doc->data, begin, doc->size, _window_todo, &w);
+}
+
+// Tasks passing a filter, collected into a table
+struct _FilterBuilder {
+  const struct Document *doc;
+  struct Filter *filter;
+  struct TodoTable *table;
+  bool failed;
+};
+
+// Keep the task in ctx's table if it passes the filter
+bool _push_match(const Todo *todo, void *ctx) {
+  struct _FilterBuilder *builder = ctx;
+  if (!filter_match(builder->filter, builder->doc->data, builder->doc->size,
+                    todo->offset, todo->length, todo->is_done)) {
+    return true;
+  }
+  if (!table_push(builder->table, todo)) {
+    builder->failed = true;
+    return false;
+  }
+  return true;
+}
+
+// Get the todos of doc passing filter into an empty table, with their IDs
+bool find_todos(const struct Document *doc, struct Filter *filter,
+                struct TodoTable *table) {
+  *table = (struct TodoTable){0};
+
+  struct _FilterBuilder builder = {
+      .doc = doc, .filter = filter, .table = table};
+  scan_todos(doc, _push_match, &builder);
+  if (builder.failed) {
+    free_table(table);
+    return false;
+  }
+  return true;
+}
+
+// Ensure the file ends with a newline, return true if one was added
+bool _ensure_newline(FILE *file) {
+  if (fseek(file, -1, SEEK_END) != 0) {
+    return false;
+  }
   int last_char = fgetc(file);
   if (last_char != '\n' && last_char != EOF) {
     fputc('\n', file);
+    return true;
   }
+  return false;
 }
 
-// Add todo to file
-bool add_todo(const char *file_path, const char *task, bool is_done) {
-  if (!_file_exist(file_path)) {
+// Append one line to the file, the body of add_todo
+bool _add_todo(const char *file_path, const char *task, bool is_done) {
+  struct stat st;
+  if (stat(file_path, &st) != 0) {
     print_err("File does not exist");
     return false;
   }
 
+  struct Index idx;
+  bool indexed = index_open(&idx, file_path, &st);
+
   FILE *file = fopen(file_path, "a+");
   if (!file) {
     print_err(strerror(errno));
+    if (indexed) {
+      index_close(&idx);
+    }
     return false;
   }
+  stats_add(STAT_OPENS, 1);
 
-  _ensure_newline(file);
-  fprintf(file, TODO_FORMAT, is_done ? 'x' : ' ', task);
+  bool newline = _ensure_newline(file);
+  int written = fprintf(file, TODO_FORMAT, is_done ? 'x' : ' ', task);
+  stats_add(STAT_BYTES_WRITTEN, newline + (written > 0 ? written : 0));
   fclose(file);
 
+  // The new line is known exactly, so the index only grows by one entry
+  size_t spaces = strspn(task, " ");
+  if (indexed && !strchr(task, '\n') && spaces <= UINT16_MAX - 6) {
+    struct IndexEntry entry = {
+        .line = st.st_size + newline,
+        .length = 6 + strlen(task),
+        .content = 6 + spaces,
+        .mark = 3,
+        .flags = is_done ? INDEX_DONE : 0,
+    };
+    index_append(&idx, file_path, &entry);
+    index_close(&idx);
+  } else {
+    if (indexed) {
+      index_close(&idx);
+    }
+    if (index_exists(file_path)) {
+      build_index(file_path);
+    }
+  }
+
   return true;
 }
 
-// Write new data to file
-bool write_todos(struct TodoNode *head, const char *file_path) {
-  FILE *file = fopen(file_path, "r");
-  if (!file) {
-    print_err(strerror(errno));
+// Add todo to file
+bool add_todo(const char *file_path, const char *task, bool is_done) {
+  struct Lock lock;
+  if (!lock_acquire(&lock, file_path)) {
+    return false;
+  }
+  bool journaled = journal_wanted(file_path);
+  bool ok = journaled ? journal_append(file_path, is_done ? "add-done" : "add",
+                                       task, DURABILITY_NONE)
+                      : _add_todo(file_path, task, is_done);
+  lock_release(&lock);
+
+  if (ok && journaled) {
+    journal_settle(file_path, DURABILITY_NONE);
+  }
+  return ok;
+}
+
+// True if path still names the inode fd was opened on, unmodified since st
+bool file_unchanged(int fd, const char *file_path, const struct stat *st) {
+  struct stat now, by_path;
+  if (fstat(fd, &now) != 0 || stat(file_path, &by_path) != 0) {
     return false;
   }
+  return now.st_size == st->st_size &&
+         now.st_mtim.tv_sec == st->st_mtim.tv_sec &&
+         now.st_mtim.tv_nsec == st->st_mtim.tv_nsec &&
+         by_path.st_dev == st->st_dev && by_path.st_ino == st->st_ino;
+}
+
+// Bitmap of the tasks sel matches, from the index or a parsed table
+uint64_t *_select(const struct Selector *sel, size_t total,
+                  const struct Index *idx, const struct TodoTable *todos) {
+  uint64_t *bits = calloc(BITMAP_WORDS(total) + 1, sizeof(uint64_t));
+  if (!bits) {
+    print_err("Memory allocation failed");
+    return NULL;
+  }
 
-  FILE *temp = fopen("temp.md", "w");
-  if (!temp) {
+  const uint64_t *done = todos ? todos->done : NULL;
+  uint64_t *flags = NULL;
+  if (idx && selector_needs_status(sel)) {
+    flags = calloc(BITMAP_WORDS(total) + 1, sizeof(uint64_t));
+    if (!flags) {
+      print_err("Memory allocation failed");
+      free(bits);
+      return NULL;
+    }
+    for (size_t i = 0; i < total; i++) {
+      if (idx->entries[i].flags & INDEX_DONE) {
+        bitmap_set(flags, i);
+      }
+    }
+    done = flags;
+  }
+
+  selector_match(sel, total, done, bits);
+  free(flags);
+  return bits;
+}
+
+// Journal op on the tasks sel matches
+bool _journal_selector(const char *file_path, const char *op,
+                       const struct Selector *sel, enum Durability durability) {
+  char *value = selector_format(sel);
+  if (!value) {
+    print_err("Memory allocation failed");
+    return false;
+  }
+  bool ok = journal_append(file_path, op, value, durability);
+  free(value);
+  return ok;
+}
+
+// Patch the checkbox bytes, the body of set_status
+bool _set_status(const char *file_path, const struct Selector *sel,
+                 bool is_done, enum Durability durability) {
+  int fd = open(file_path, O_RDWR);
+  if (fd < 0) {
     print_err(strerror(errno));
-    fclose(file);
     return false;
   }
+  stats_add(STAT_OPENS, 1);
+
+  struct Document doc;
+  if (!doc_map(&doc, fd)) {
+    close(fd);
+    return false;
+  }
+
+  // With an index every task is found directly, otherwise parse up to the
+  // highest requested ID, tasks after it are never looked at
+  struct Index idx;
+  bool indexed = index_open(&idx, file_path, &doc.st);
+
+  struct TodoTable todos = {0};
+  if (!indexed && !_list_until(&doc, &todos, selector_limit(sel))) {
+    doc_close(&doc);
+    close(fd);
+    return false;
+  }
+  size_t total = indexed ? idx.count : todos.count;
+
+  uint64_t *selected = _select(sel, total, indexed ? &idx : NULL,
+                               indexed ? NULL : &todos);
+  bool ok = selected != NULL;
+
+  if (ok && !file_unchanged(fd, file_path, &doc.st)) {
+    print_err("File changed while updating, try again");
+    ok = false;
+  }
+
+  char mark = is_done ? 'x' : ' ';
 
-  char buffer[1024];
+  // One pass over the selected positions in file order
+  for (size_t index = ok ? bitmap_next(selected, 0, total) : total;
+       index < total; index = bitmap_next(selected, index + 1, total)) {
+    struct IndexEntry *entry = indexed ? &idx.entries[index] : NULL;
 
-  // Copy only lines before the target line
-  while (fgets(buffer, sizeof(buffer), file)) {
-    if (buffer[0] == '-') {
+    bool done = entry ? entry->flags & INDEX_DONE
+                      : bitmap_get(todos.done, index);
+    if (done == is_done) {
+      continue;
+    }
+
+    // Re-read "[?]" from the file so a concurrent edit is never clobbered
+    off_t offset = entry ? (off_t)(entry->line + entry->mark)
+                         : (off_t)mark_offset(doc.data, todos.lines[index]);
+    char box[3];
+    if (pread(fd, box, sizeof(box), offset - 1) != sizeof(box) ||
+        box[0] != '[' || box[2] != ']') {
+      print_err("File changed while updating, try again");
+      ok = false;
+      break;
+    }
+
+    stats_add(STAT_BYTES_WRITTEN, 1);
+    if (pwrite(fd, &mark, 1, offset) != 1) {
+      print_err(strerror(errno));
+      ok = false;
       break;
     }
-    fputs(buffer, temp);
+
+    if (entry) {
+      entry->flags = is_done ? entry->flags | INDEX_DONE
+                             : entry->flags & ~INDEX_DONE;
+    } else {
+      bitmap_put(todos.done, index, is_done);
+    }
   }
 
-  fclose(file);
-  fclose(temp);
+  stats_add(STAT_FSYNCS, ok && durability >= DURABILITY_FILE);
+  if (ok && durability >= DURABILITY_FILE && fdatasync(fd) != 0) {
+    print_err(strerror(errno));
+    ok = false;
+  }
 
-  remove(file_path);
-  rename("temp.md", file_path);
+  // Restamp only after the file itself changed, a crash in between just
+  // leaves an index that no longer matches and gets rebuilt
+  if (indexed) {
+    if (ok) {
+      index_stamp(&idx, file_path);
+    }
+    index_close(&idx);
+  } else if (index_exists(file_path)) {
+    build_index(file_path);
+  }
 
-  // If head is NULL, just return true to clear all tasks
-  if (!head) {
-    return true;
+  free(selected);
+  free_table(&todos);
+  doc_close(&doc);
+  close(fd);
+  return ok;
+}
+
+// Set the status of tasks by patching their checkbox byte in place
+bool set_status(const char *file_path, const struct Selector *sel,
+                bool is_done, enum Durability durability) {
+  struct Lock lock;
+  if (!lock_acquire(&lock, file_path)) {
+    return false;
+  }
+  bool journaled = journal_wanted(file_path);
+  bool ok = journaled ? _journal_selector(file_path, is_done ? "done" : "undone",
+                                          sel, durability)
+                      : _set_status(file_path, sel, is_done, durability);
+  lock_release(&lock);
+
+  if (ok && journaled) {
+    journal_settle(file_path, durability);
+  }
+  return ok;
+}
+
+// Mark a task as done
+bool done_task(const char *file_path, uint32_t id) {
+  struct Selector sel;
+  if (!selector_id(&sel, id)) {
+    print_err("Memory allocation failed");
+    return false;
+  }
+
+  bool ok = set_status(file_path, &sel, true, DURABILITY_NONE);
+  selector_free(&sel);
+  return ok;
+}
+
+// Splice the kept ranges into a new file, the body of remove_todos
+bool _remove_todos(const char *file_path, const struct Selector *sel,
+                   enum Durability durability) {
+  int fd = open(file_path, O_RDONLY);
+  if (fd < 0) {
+    print_err(strerror(errno));
+    return false;
+  }
+  stats_add(STAT_OPENS, 1);
+
+  struct Document doc;
+  if (!doc_map(&doc, fd)) {
+    close(fd);
+    return false;
+  }
+
+  // Tasks after the highest requested ID are copied without being parsed
+  struct Index idx;
+  bool indexed = index_open(&idx, file_path, &doc.st);
+
+  struct TodoTable todos = {0};
+  if (!indexed && !_list_until(&doc, &todos, selector_limit(sel))) {
+    doc_close(&doc);
+    close(fd);
+    return false;
+  }
+  size_t total = indexed ? idx.count : todos.count;
+
+  uint64_t *drop = _select(sel, total, indexed ? &idx : NULL,
+                           indexed ? NULL : &todos);
+  if (!drop) {
+    if (indexed) {
+      index_close(&idx);
+    }
+    free_table(&todos);
+    doc_close(&doc);
+    close(fd);
+    return false;
+  }
+
+  // Each removed line is one edit, the spans between them are copied in
+  // one go
+  struct PieceTable pt;
+  pieces_init(&pt, &doc, fd);
+  bool ok = true;
+  for (size_t i = bitmap_next(drop, 0, total); ok && i < total;
+       i = bitmap_next(drop, i + 1, total)) {
+    size_t line = indexed ? idx.entries[i].line : todos.lines[i];
+    size_t end = indexed ? line + idx.entries[i].length
+                         : todos.offsets[i] + todos.lengths[i];
+    size_t next = end < doc.size ? end + 1 : end;
+    ok = pieces_replace(&pt, line, next - line, NULL, 0);
+  }
+
+  struct Writer w = {.fd = -1};
+  ok = ok && writer_open(&w, file_path, durability) && pieces_write(&pt, &w);
+  pieces_free(&pt);
+
+  if (ok && !file_unchanged(fd, file_path, &doc.st)) {
+    print_err("File changed while updating, try again");
+    ok = false;
+  }
+
+  if (ok) {
+    ok = writer_commit(&w);
+  } else if (w.path) {
+    writer_abort(&w);
+  }
+
+  // Shift the surviving entries by the bytes removed before them
+  if (ok && indexed) {
+    size_t kept = 0, removed = 0;
+    for (size_t i = 0; i < total; i++) {
+      struct IndexEntry e = idx.entries[i];
+      if (bitmap_get(drop, i)) {
+        removed += e.line + e.length < doc.size ? e.length + 1 : e.length;
+        continue;
+      }
+      e.line -= removed;
+      idx.entries[kept++] = e;
+    }
+    index_write(file_path, &w.st, idx.entries, kept);
+  } else if (ok && index_exists(file_path)) {
+    build_index(file_path);
+  }
+
+  if (indexed) {
+    index_close(&idx);
+  }
+  free(drop);
+  free_table(&todos);
+  doc_close(&doc);
+  close(fd);
+  return ok;
+}
+
+// Remove tasks by splicing the untouched byte ranges into a new file
+bool remove_todos(const char *file_path, const struct Selector *sel,
+                  enum Durability durability) {
+  struct Lock lock;
+  if (!lock_acquire(&lock, file_path)) {
+    return false;
+  }
+  bool journaled = journal_wanted(file_path);
+  bool ok = journaled
+                ? _journal_selector(file_path, "remove", sel, durability)
+                : _remove_todos(file_path, sel, durability);
+  lock_release(&lock);
+
+  if (ok && journaled) {
+    journal_settle(file_path, durability);
+  }
+  return ok;
+}
+
+// Rewrite the file from doc and table, the body of write_todos
+bool _write_todos(const struct Document *doc, const struct TodoTable *table,
+                  const char *file_path, enum Durability durability) {
+  struct TodoTable all;
+  if (!list_todos(doc, &all)) {
+    return false;
   }
 
-  struct TodoNode *elt, *tmp;
+  // Task lines missing from table are cut out and checkboxes that differ
+  // are patched, headings, notes and indentation stay as they are
+  struct PieceTable pt;
+  pieces_init(&pt, doc, -1);
+  bool ok = true;
+  size_t j = 0;
+  for (size_t i = 0; ok && i < all.count; i++) {
+    size_t line = all.lines[i];
+    while (table && j < table->count && table->lines[j] < line) {
+      j++;
+    }
+
+    if (!table || j == table->count || table->lines[j] != line) {
+      size_t end = all.offsets[i] + all.lengths[i];
+      size_t next = end < doc->size ? end + 1 : end;
+      ok = pieces_replace(&pt, line, next - line, NULL, 0);
+      continue;
+    }
 
-  DL_FOREACH_SAFE(head, elt, tmp) {
-    add_todo(file_path, elt->todo.content, elt->todo.is_done);
+    bool is_done = bitmap_get(table->done, j);
+    if (is_done != bitmap_get(all.done, i)) {
+      ok = pieces_replace(&pt, mark_offset(doc->data, line), 1,
+                          is_done ? "x" : " ", 1);
+    }
   }
 
+  struct Writer w = {.fd = -1};
+  ok = ok && writer_open(&w, file_path, durability) && pieces_write(&pt, &w);
+  if (ok) {
+    ok = writer_commit(&w);
+  } else if (w.path) {
+    writer_abort(&w);
+  }
+  pieces_free(&pt);
+  free_table(&all);
+  if (!ok) {
+    return false;
+  }
+
+  if (index_exists(file_path)) {
+    build_index(file_path);
+  }
   return true;
 }
+
+// Write new data to file
+bool write_todos(const struct Document *doc, const struct TodoTable *table,
+                 const char *file_path, enum Durability durability) {
+  struct Lock lock;
+  if (!lock_acquire(&lock, file_path)) {
+    return false;
+  }
+  // Clearing is one more record, a full rewrite folds the journal away
+  bool ok;
+  if (!table && journal_wanted(file_path)) {
+    ok = journal_append(file_path, "clear", NULL, durability);
+  } else {
+    ok = _write_todos(doc, table, file_path, durability);
+    if (ok) {
+      journal_remove(file_path);
+    }
+  }
+  lock_release(&lock);
+  return ok;
+}
@@ -28,41 +28,141 @@
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <sys/stat.h>
 
+#include "../utils/arena.h"
+#include "../utils/bitmap.h"
+#include "filter.h"
+#include "index.h"
+#include "selector.h"
+#include "writer.h"
+
+// Read-only view of a TODO file mapped into memory
+struct Document {
+  char *data;
+  size_t size;
+  struct stat st; // Identity of the file when it was mapped
+};
+
+// A task, its content is a view into the document it was parsed from
 typedef struct {
   uint32_t id;
-  char content[1024];
+  size_t line;   // Offset of the start of the task line
+  size_t offset; // Offset of the task content
+  size_t length; // Length of the task content
   bool is_done;
 } Todo;
 
-struct TodoNode {
-  Todo todo;
-  struct TodoNode *next;
-  struct TodoNode *prev;
+// Called for every task found by scan_todos, return false to stop
+typedef bool (*todo_fn)(const Todo *todo, void *ctx);
+
+// Tasks of a document stored column by column, all columns live in arena
+struct TodoTable {
+  struct Arena arena;
+  size_t count;
+  size_t capacity;
+  uint32_t *ids;
+  uint64_t *done;    // Status bitmap, one bit per task
+  size_t *lines;     // Offset of each task line
+  size_t *offsets;   // Offset of each task content
+  uint32_t *lengths; // Length of each task content
 };
 
 // Init the TODO.md or other name if user want ._.
-bool init(const char *file_path, const char *title);
+bool init(const char *file_path, const char *title,
+          enum Durability durability);
+
+// Map file_path read-only into doc
+bool doc_open(struct Document *doc, const char *file_path);
+
+// Map the file behind fd read-only into doc
+bool doc_map(struct Document *doc, int fd);
+
+// Unmap a document opened with doc_open
+void doc_close(struct Document *doc);
+
+// True if path still names the inode fd was opened on, unmodified since st
+bool file_unchanged(int fd, const char *file_path, const struct stat *st);
+
+// Parse the line [line, end) of data, fill todo if it is a task
+bool _parse_line(const char *data, size_t line, size_t end, Todo *todo);
+
+// Offset of the status byte inside "- [ ]" for the task line at line
+size_t mark_offset(const char *data, size_t line);
+
+// Call fn for every task in doc in file order, stop early if fn returns false
+void scan_todos(const struct Document *doc, todo_fn fn, void *ctx);
+
+// Call fn for the tasks whose lines start in [begin, end) of doc, numbered
+// from 1. begin must be a line start.
+void scan_range(const struct Document *doc, size_t begin, size_t end,
+                todo_fn fn, void *ctx);
 
-// Get all todos, return the pointer to head of linked list
-struct TodoNode *list_todos(const char *file_path);
+// Get all todos of doc into an empty table, large documents are parsed in
+// parallel
+bool list_todos(const struct Document *doc, struct TodoTable *table);
 
-// Release memory of todo list
-void free_list(struct TodoNode *head);
+// Use threads parser threads, 0 picks a count from the document size
+void set_parse_threads(size_t threads);
+
+// Append one task to the table
+bool table_push(struct TodoTable *table, const Todo *todo);
+
+// Read task i back from the table
+Todo table_get(const struct TodoTable *table, size_t i);
+
+// Drop every task whose bit is set in drop, keeping the order of the rest
+void table_compact(struct TodoTable *table, const uint64_t *drop);
+
+// Release memory of todo table
+void free_table(struct TodoTable *table);
+
+// Get all todos of doc, through its sidecar index when it is up to date
+bool load_todos(const struct Document *doc, const char *file_path,
+                struct TodoTable *table);
+
+// Count the todos of file_path, from the index header when possible
+bool count_todos(const char *file_path, size_t *count);
+
+// Call fn for the tasks with IDs in (skip, skip + limit], limit 0 meaning no
+// limit, parsing no further than needed
+void window_todos(const struct Document *doc, const char *file_path,
+                  size_t skip, size_t limit, todo_fn fn, void *ctx);
+
+// Get the todos of doc passing filter into an empty table, with their IDs
+bool find_todos(const struct Document *doc, struct Filter *filter,
+                struct TodoTable *table);
+
+// Index entries describing the tasks of table, caller frees them
+struct IndexEntry *index_entries(const struct Document *doc,
+                                 const struct TodoTable *table);
+
+// Parse file_path and write a fresh sidecar index for it, as its writer
+bool build_index(const char *file_path);
+
+// Make sure file_path has an up to date sidecar index. A reader only
+// rebuilds it while no writer is in, from a parse the file still matches.
+bool refresh_index(const char *file_path);
 
 // Add todo to file
 bool add_todo(const char *file_path, const char *task, bool is_done);
 
-// Check the file if exist
-bool _file_exist(const char *file_path);
+// Ensure the file ends with a newline, return true if one was added
+bool _ensure_newline(FILE *file);
 
-// Ensure the file ends with a newline
-void _ensure_newline(FILE *file);
+// Set the status of tasks by patching their checkbox byte in place
+bool set_status(const char *file_path, const struct Selector *sel,
+                bool is_done, enum Durability durability);
 
 // Mark a task as done
-bool done_task(const char *file_path, int id);
+bool done_task(const char *file_path, uint32_t id);
+
+// Remove tasks by splicing the untouched byte ranges into a new file
+bool remove_todos(const char *file_path, const struct Selector *sel,
+                  enum Durability durability);
 
 // Write new data to file
-bool write_todos(struct TodoNode *head, const char *file_path);
+bool write_todos(const struct Document *doc, const struct TodoTable *table,
+                 const char *file_path, enum Durability durability);
 
 #endif
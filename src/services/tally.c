@@ -0,0 +1,197 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2025 Võ Quang Chiến
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "tally.h"
+
+#include <string.h>
+#include <sys/stat.h>
+
+#include "index.h"
+#include "journal.h"
+
+// State of one counting pass: the totals, the section being read and
+// where the last task line ended
+struct _Count {
+  struct Tally *tally;
+  struct Tally section;
+  const char *title;
+  size_t len;
+  const char *data;
+  size_t next;
+  char fence;       // ` or ~ while inside a code fence, 0 outside
+  size_t fence_len; // Length of the opening fence
+  section_fn fn;
+  void *ctx;
+  bool stopped;
+};
+
+// Hand a finished section to fn, false if fn wants to stop
+bool _end_section(struct _Count *c) {
+  if (c->section.total == 0) {
+    return true;
+  }
+  c->stopped = !c->fn(c->title, c->len, &c->section, c->ctx);
+  c->section = (struct Tally){0};
+  return !c->stopped;
+}
+
+// Length of the ``` or ~~~ run that opens or closes a code fence on the
+// line [line, end), 0 if it is no fence. *mark is set to its character.
+size_t _fence_run(const char *line, const char *end, char *mark) {
+  const char *p = line;
+  while (p < end && p - line < 3 && *p == ' ') {
+    p++;
+  }
+  if (p == end || (*p != '`' && *p != '~')) {
+    return 0;
+  }
+
+  const char *run = p;
+  while (p < end && *p == *run) {
+    p++;
+  }
+  *mark = *run;
+  return p - run >= 3 ? (size_t)(p - run) : 0;
+}
+
+// An ATX heading: one to six '#' followed by a space, a tab or nothing
+bool _is_heading(const char *line, const char *end) {
+  const char *p = line;
+  while (p < end && *p == '#') {
+    p++;
+  }
+  size_t level = p - line;
+  return level >= 1 && level <= 6 &&
+         (p == end || *p == ' ' || *p == '\t' || *p == '\r');
+}
+
+// Start of the last heading outside code fences among the lines of
+// [c->next, to), to if none. A fence left open carries over to the lines
+// after the task that follows.
+size_t _last_heading(struct _Count *c, size_t to) {
+  size_t heading = to;
+  for (size_t line = c->next; line < to;) {
+    const char *start = c->data + line;
+    const char *nl = memchr(start, '\n', to - line);
+    const char *end = nl ? nl : c->data + to;
+
+    char mark;
+    size_t run = _fence_run(start, end, &mark);
+    if (c->fence) {
+      if (run >= c->fence_len && mark == c->fence) {
+        c->fence = 0;
+      }
+    } else if (run > 0) {
+      c->fence = mark;
+      c->fence_len = run;
+    } else if (_is_heading(start, end)) {
+      heading = line;
+    }
+    line = (size_t)(end - c->data) + 1;
+  }
+  return heading;
+}
+
+// Close the section, if a heading sits between the previous task and the
+// line at line, and start the one of that heading
+bool _next_section(struct _Count *c, size_t line) {
+  size_t heading = _last_heading(c, line);
+  if (heading == line) {
+    return true;
+  }
+  if (!_end_section(c)) {
+    return false;
+  }
+
+  const char *p = c->data + heading;
+  const char *end = memchr(p, '\n', line - heading);
+  end = end ? end : c->data + line;
+  while (p < end && *p == '#') {
+    p++;
+  }
+  while (p < end && *p == ' ') {
+    p++;
+  }
+  while (end > p && (end[-1] == ' ' || end[-1] == '\r')) {
+    end--;
+  }
+  c->title = p;
+  c->len = end - p;
+  return true;
+}
+
+// Count one task of the parser's scan
+bool _count_todo(const Todo *todo, void *ctx) {
+  struct _Count *c = ctx;
+  if (c->fn && !_next_section(c, todo->line)) {
+    return false;
+  }
+  c->next = todo->offset + todo->length + 1;
+
+  c->tally->total++;
+  c->tally->done += todo->is_done;
+  c->section.total++;
+  c->section.done += todo->is_done;
+  return true;
+}
+
+// Count the tasks of doc in one pass without allocating, calling fn for
+// every section if it is set
+void tally_doc(const struct Document *doc, struct Tally *tally, section_fn fn,
+               void *ctx) {
+  // Tasks come from the parser's own scan, headings are looked for only in
+  // the lines between two tasks
+  *tally = (struct Tally){0};
+  struct _Count c = {
+      .tally = tally, .title = "", .data = doc->data, .fn = fn, .ctx = ctx};
+  scan_todos(doc, _count_todo, &c);
+  if (fn && !c.stopped) {
+    _end_section(&c);
+  }
+}
+
+// Count the tasks of file_path, from its sidecar index when it is current.
+// A pending journal is replayed by doc_load, which allocates.
+bool tally_file(const char *file_path, struct Tally *tally) {
+  // The flags of a current index hold every status, the file is not read
+  struct stat st;
+  struct Index idx;
+  if (journal_size(file_path) == 0 && stat(file_path, &st) == 0 &&
+      index_open(&idx, file_path, &st)) {
+    *tally = (struct Tally){.total = idx.count};
+    for (size_t i = 0; i < idx.count; i++) {
+      tally->done += idx.entries[i].flags & INDEX_DONE;
+    }
+    index_close(&idx);
+    return true;
+  }
+
+  struct Document doc;
+  if (!doc_load(&doc, file_path)) {
+    return false;
+  }
+  tally_doc(&doc, tally, NULL, NULL);
+  doc_close(&doc);
+  return true;
+}
@@ -0,0 +1,53 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2025 Võ Quang Chiến
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef TALLY_H
+#define TALLY_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "storage.h"
+
+// Task counts of a document or of one of its sections
+struct Tally {
+  size_t total;
+  size_t done;
+};
+
+// Called with the counts of each heading section that holds tasks, title
+// is empty for tasks above the first heading. Return false to stop.
+typedef bool (*section_fn)(const char *title, size_t len,
+                           const struct Tally *tally, void *ctx);
+
+// Count the tasks of doc in one pass without allocating, calling fn for
+// every section if it is set
+void tally_doc(const struct Document *doc, struct Tally *tally, section_fn fn,
+               void *ctx);
+
+// Count the tasks of file_path, from its sidecar index when it is current.
+// A pending journal is replayed by doc_load, which allocates.
+bool tally_file(const char *file_path, struct Tally *tally);
+
+#endif
@@ -0,0 +1,466 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2025 Võ Quang Chiến
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "watch.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <sys/ioctl.h>
+#include <sys/signalfd.h>
+#include <unistd.h>
+
+#include "../utils/fmt.h"
+#include "../utils/render.h"
+#include "../utils/stats.h"
+#include "journal.h"
+#include "storage.h"
+
+// Constants
+#define WATCH_BLOCK_SIZE (64 * 1024) // Unit of change detection
+#define WATCH_DEBOUNCE_MS 15         // Quiet time that ends a burst of writes
+#define WATCH_DEBOUNCE_MAX_MS 100    // Redraw at least this often meanwhile
+#define WATCH_MIN_TASK_WIDTH 4
+#define WATCH_MASK                                                             \
+  (IN_CLOSE_WRITE | IN_MODIFY | IN_MOVED_TO | IN_MOVED_FROM | IN_DELETE |      \
+   IN_CREATE | IN_ATTRIB)
+#define WATCH_FIRST_ROW 5 // Status line, top border, header and separator
+#define SCREEN_ENTER "\x1b[?1049h\x1b[?25l" // Alternate screen, no cursor
+#define SCREEN_LEAVE "\x1b[?25h\x1b[?1049l"
+
+// A run of whole lines of the document and what it held last time
+struct _Block {
+  size_t begin;
+  size_t end;
+  uint64_t hash;
+  size_t tasks;
+  size_t done;
+};
+
+// What is on screen and how the document looked when it was drawn
+struct _Watch {
+  const char *path;
+  const char *base; // File name inside path, matched against events
+  bool tty;
+  struct Document doc;
+  struct _Block *blocks;
+  size_t block_count;
+  size_t tasks;
+  size_t done;
+  uint64_t *rows; // Hash of each row on screen
+  size_t row_count;
+  int task_width;
+  bool drawn; // Screen holds a table that later draws can patch
+};
+
+// Mix one word into a hash lane
+static inline uint64_t _mix(uint64_t h, uint64_t word) {
+  h = (h ^ word) * 0xff51afd7ed558ccdull;
+  return h ^ (h >> 32);
+}
+
+// Hash of len bytes. Four independent lanes take 32 bytes per round so the
+// multiplies overlap instead of waiting on each other.
+uint64_t _hash(const char *data, size_t len) {
+  uint64_t lanes[4] = {0x9e3779b97f4a7c15ull ^ len, 0xc2b2ae3d27d4eb4full,
+                       0x165667b19e3779f9ull, 0x27d4eb2f165667c5ull};
+  size_t i = 0;
+  for (; i + 32 <= len; i += 32) {
+    uint64_t words[4];
+    memcpy(words, data + i, sizeof(words));
+    for (int k = 0; k < 4; k++) {
+      lanes[k] = _mix(lanes[k], words[k]);
+    }
+  }
+
+  uint64_t h = lanes[0] ^ (lanes[1] * 3) ^ (lanes[2] * 5) ^ (lanes[3] * 7);
+  for (; i + 8 <= len; i += 8) {
+    uint64_t word;
+    memcpy(&word, data + i, sizeof(word));
+    h = _mix(h, word);
+  }
+  uint64_t tail = 0;
+  memcpy(&tail, data + i, len - i);
+  return _mix(h, tail);
+}
+
+// Count the tasks of one block as it is parsed
+bool _count_task(const Todo *todo, void *ctx) {
+  struct _Block *block = ctx;
+  block->tasks++;
+  block->done += todo->is_done;
+  return true;
+}
+
+// Append a block, false if out of memory
+bool _push_block(struct _Block **blocks, size_t *count, size_t *capacity,
+                 const struct _Block *block) {
+  if (*count == *capacity) {
+    size_t grown = *capacity ? *capacity * 2 : 64;
+    struct _Block *resized = realloc(*blocks, grown * sizeof(**blocks));
+    if (!resized) {
+      return false;
+    }
+    *blocks = resized;
+    *capacity = grown;
+  }
+  (*blocks)[(*count)++] = *block;
+  return true;
+}
+
+// Cut [begin, end) of doc into line-aligned blocks and parse them
+bool _parse_blocks(const struct Document *doc, size_t begin, size_t end,
+                   struct _Block **blocks, size_t *count, size_t *capacity) {
+  while (begin < end) {
+    size_t cut = end - begin > WATCH_BLOCK_SIZE ? begin + WATCH_BLOCK_SIZE
+                                                : end;
+    const char *newline = memchr(doc->data + cut - 1, '\n', end - cut + 1);
+    cut = newline ? (size_t)(newline - doc->data) + 1 : end;
+
+    struct _Block block = {.begin = begin, .end = cut};
+    block.hash = _hash(doc->data + begin, cut - begin);
+    scan_range(doc, begin, cut, _count_task, &block);
+    if (!_push_block(blocks, count, capacity, &block)) {
+      return false;
+    }
+    begin = cut;
+  }
+  return true;
+}
+
+// True if bytes [begin, end) of doc still hold the lines of block
+bool _block_kept(const struct Document *doc, const struct _Block *block,
+                 size_t begin) {
+  size_t end = begin + (block->end - block->begin);
+  return end <= doc->size && (begin == 0 || doc->data[begin - 1] == '\n') &&
+         (end == doc->size || doc->data[end - 1] == '\n') &&
+         _hash(doc->data + begin, end - begin) == block->hash;
+}
+
+// Switch to a new version of the document. Blocks that hash the same at
+// the start and at the end keep their counts, only the lines between them
+// are parsed again.
+bool _update(struct _Watch *w, struct Document *doc) {
+  size_t old_count = w->block_count;
+  size_t prefix = 0;
+  while (prefix < old_count &&
+         _block_kept(doc, &w->blocks[prefix], w->blocks[prefix].begin)) {
+    prefix++;
+  }
+  size_t parsed_from = prefix > 0 ? w->blocks[prefix - 1].end : 0;
+
+  // The rest of the file moved by the size difference
+  size_t suffix = old_count;
+  size_t old_size = w->doc.size;
+  while (suffix > prefix) {
+    const struct _Block *block = &w->blocks[suffix - 1];
+    if (doc->size + block->begin < old_size) {
+      break;
+    }
+    size_t begin = block->begin + doc->size - old_size;
+    if (begin < parsed_from || !_block_kept(doc, block, begin)) {
+      break;
+    }
+    suffix--;
+  }
+  size_t parsed_to = suffix < old_count
+                         ? w->blocks[suffix].begin + doc->size - old_size
+                         : doc->size;
+
+  struct _Block *blocks = NULL;
+  size_t count = 0, capacity = 0;
+  bool ok = true;
+  for (size_t i = 0; ok && i < prefix; i++) {
+    ok = _push_block(&blocks, &count, &capacity, &w->blocks[i]);
+  }
+  ok = ok && _parse_blocks(doc, parsed_from, parsed_to, &blocks, &count,
+                           &capacity);
+  for (size_t i = suffix; ok && i < old_count; i++) {
+    struct _Block block = w->blocks[i];
+    block.begin += doc->size - old_size;
+    block.end += doc->size - old_size;
+    ok = _push_block(&blocks, &count, &capacity, &block);
+  }
+  if (!ok) {
+    print_err("Memory allocation failed");
+    free(blocks);
+    return false;
+  }
+
+  free(w->blocks);
+  w->blocks = blocks;
+  w->block_count = count;
+  w->tasks = 0;
+  w->done = 0;
+  for (size_t i = 0; i < count; i++) {
+    w->tasks += blocks[i].tasks;
+    w->done += blocks[i].done;
+  }
+
+  doc_close(&w->doc);
+  w->doc = *doc;
+  return true;
+}
+
+// Rows of one draw, collected up to the number that fit on screen
+struct _Rows {
+  Todo *todos;
+  size_t count;
+  size_t limit;
+};
+
+// Keep one task for the screen
+bool _collect_row(const Todo *todo, void *ctx) {
+  struct _Rows *rows = ctx;
+  rows->todos[rows->count++] = *todo;
+  return rows->count < rows->limit;
+}
+
+// Read the terminal size, 80x24 off a terminal
+struct winsize _screen_size(const struct _Watch *w) {
+  struct winsize ws = {.ws_row = 24, .ws_col = 80};
+  if (w->tty) {
+    ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws);
+  }
+  return ws;
+}
+
+// Draw the document, patching only rows that changed unless full is set.
+// Off a terminal every change prints the whole table again.
+bool _draw(struct _Watch *w, bool full) {
+  struct winsize ws = _screen_size(w);
+  size_t limit = w->tasks;
+  if (w->tty) {
+    // Below the rows come the bottom border and the line its newline opens
+    int room = ws.ws_row - WATCH_FIRST_ROW - 1;
+    limit = room > 0 ? (size_t)room : 0;
+    limit = limit < w->tasks ? limit : w->tasks;
+  }
+
+  // The task column takes what the borders, IDs and Done leave over
+  int room = ws.ws_col - 4 - (num_digits(limit) + 2) - 6 - 2;
+  int task_width = room > WATCH_MIN_TASK_WIDTH ? room : WATCH_MIN_TASK_WIDTH;
+  full = full || !w->tty || !w->drawn || task_width != w->task_width ||
+         num_digits(limit) != num_digits(w->row_count) ||
+         (limit == 0) != (w->row_count == 0);
+
+  struct _Rows rows = {.limit = limit};
+  uint64_t *hashes = malloc((limit + 1) * sizeof(*hashes));
+  rows.todos = malloc((limit + 1) * sizeof(*rows.todos));
+  if (!hashes || !rows.todos) {
+    print_err("Memory allocation failed");
+    free(hashes);
+    free(rows.todos);
+    return false;
+  }
+  if (limit > 0) {
+    scan_range(&w->doc, 0, w->doc.size, _collect_row, &rows);
+  }
+
+  if (w->tty) {
+    printf(full ? "\x1b[H\x1b[2J" : "\x1b[H\x1b[2K");
+    printf(STYLE_BOLD "%s" STYLE_RESET ": %zu tasks, %zu done", w->path,
+           w->tasks, w->done);
+    if (limit < w->tasks) {
+      printf(", first %zu shown", limit);
+    }
+    printf("\n");
+  }
+  if (w->tasks == 0) {
+    print_info("No task in %s. Yeah!", w->path);
+  }
+
+  struct Render r;
+  bool ok = true;
+  if (rows.count > 0) {
+    ok = full ? render_begin(&r, STDOUT_FILENO, rows.count, task_width)
+              : render_continue(&r, STDOUT_FILENO, rows.count,
+                                task_width);
+    for (size_t i = 0; ok && i < rows.count; i++) {
+      const Todo *todo = &rows.todos[i];
+      const char *text = w->doc.data + todo->offset;
+      hashes[i] = _hash(text, todo->length) * 2 + todo->is_done;
+      if (!full && i < w->row_count && hashes[i] == w->rows[i]) {
+        continue;
+      }
+      if (!full) {
+        render_goto(&r, WATCH_FIRST_ROW + i);
+      }
+      render_row(&r, todo->id, text, todo->length, todo->is_done);
+    }
+    if (!full) {
+      render_goto(&r, WATCH_FIRST_ROW + rows.count);
+    }
+    ok = render_end(&r) && ok;
+  }
+  if (w->tty) {
+    printf("\x1b[J"); // Rows left from a longer list
+  }
+  fflush(stdout);
+
+  free(w->rows);
+  free(rows.todos);
+  w->rows = hashes;
+  w->row_count = rows.count;
+  w->task_width = task_width;
+  w->drawn = true;
+  return ok;
+}
+
+// Load the current version of the file and draw what changed
+bool _refresh(struct _Watch *w, bool full) {
+  size_t span = stats_begin("refresh");
+  struct Document doc;
+  quiet_errors_begin(); // Mid-save the file can be missing for a moment
+  bool loaded = doc_load(&doc, w->path);
+  quiet_errors_end();
+
+  bool ok = loaded ? _update(w, &doc) : w->drawn;
+  if (loaded && !ok) {
+    doc_close(&doc);
+  }
+  if (ok && (loaded || full)) {
+    ok = _draw(w, full);
+  }
+  stats_end(span);
+  return ok;
+}
+
+// True if the queued inotify events touch the document or its journal
+bool _read_events(int fd, const struct _Watch *w) {
+  char events[16 * 1024]
+      __attribute__((aligned(__alignof__(struct inotify_event))));
+
+  bool touched = false;
+  ssize_t n;
+  while ((n = read(fd, events, sizeof(events))) > 0) {
+    for (char *p = events; p < events + n;) {
+      struct inotify_event *ev = (struct inotify_event *)p;
+      touched = touched || ev->len == 0 || strcmp(ev->name, w->base) == 0 ||
+                is_journal_of(ev->name, w->base);
+      p += sizeof(*ev) + ev->len;
+    }
+  }
+  return touched;
+}
+
+// Wait until a burst of events has been quiet for a moment, but no longer
+// than the debounce limit
+void _debounce(int fd, const struct _Watch *w) {
+  struct pollfd pfd = {.fd = fd, .events = POLLIN};
+  int waited = 0;
+  while (waited < WATCH_DEBOUNCE_MAX_MS &&
+         poll(&pfd, 1, WATCH_DEBOUNCE_MS) > 0) {
+    _read_events(fd, w);
+    waited += WATCH_DEBOUNCE_MS;
+  }
+}
+
+// Show the tasks of file_path and keep the table up to date as the file
+// changes, until interrupted
+bool watch_file(const char *file_path) {
+  struct _Watch w = {.path = file_path, .tty = isatty(STDOUT_FILENO)};
+  const char *slash = strrchr(file_path, '/');
+  w.base = slash ? slash + 1 : file_path;
+
+  // Watch the directory, editors often save by renaming over the file
+  char *dir = slash ? strndup(file_path, slash - file_path + 1) : strdup(".");
+  int inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  bool watching = dir && inotify_fd >= 0 &&
+                  inotify_add_watch(inotify_fd, dir, WATCH_MASK) >= 0;
+  free(dir);
+
+  sigset_t signals;
+  sigemptyset(&signals);
+  sigaddset(&signals, SIGINT);
+  sigaddset(&signals, SIGTERM);
+  sigaddset(&signals, SIGWINCH);
+  int signal_fd = -1;
+  if (watching && sigprocmask(SIG_BLOCK, &signals, NULL) == 0) {
+    signal_fd = signalfd(-1, &signals, SFD_NONBLOCK | SFD_CLOEXEC);
+  }
+  if (!watching || signal_fd < 0 || !doc_load(&w.doc, file_path)) {
+    if (!watching || signal_fd < 0) {
+      print_err(strerror(errno));
+    }
+    if (inotify_fd >= 0) {
+      close(inotify_fd);
+    }
+    return false;
+  }
+
+  // The first version is parsed like any change, against an empty file
+  struct Document first = w.doc;
+  w.doc = (struct Document){0};
+  if (w.tty) {
+    printf(SCREEN_ENTER);
+  }
+  bool ok = _update(&w, &first) && _draw(&w, true);
+
+  struct pollfd fds[] = {
+      {.fd = inotify_fd, .events = POLLIN},
+      {.fd = signal_fd, .events = POLLIN},
+  };
+  bool running = ok;
+  while (running) {
+    // Nothing to do until the kernel reports something, no timeout
+    if (poll(fds, 2, -1) < 0) {
+      running = errno == EINTR;
+      continue;
+    }
+
+    bool full = false;
+    if (fds[1].revents & POLLIN) {
+      struct signalfd_siginfo info;
+      while (read(signal_fd, &info, sizeof(info)) == sizeof(info)) {
+        running = running && info.ssi_signo == SIGWINCH;
+        full = true;
+      }
+    }
+    bool touched = (fds[0].revents & POLLIN) && _read_events(inotify_fd, &w);
+    if (touched) {
+      _debounce(inotify_fd, &w);
+    }
+    if (running && (touched || full) && !_refresh(&w, full)) {
+      running = ok = false;
+    }
+  }
+
+  if (w.tty) {
+    printf(SCREEN_LEAVE);
+    fflush(stdout);
+  }
+  close(signal_fd);
+  close(inotify_fd);
+  sigprocmask(SIG_UNBLOCK, &signals, NULL);
+  doc_close(&w.doc);
+  free(w.blocks);
+  free(w.rows);
+  return ok;
+}
@@ -0,0 +1,476 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2025 Võ Quang Chiến
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "workspace.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <fnmatch.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "../utils/fmt.h"
+#include "../utils/stats.h"
+#include "journal.h"
+
+// Constants
+#define WORKSPACE_MIN_THREADS 4 // Walking waits on the disk, overlap it
+#define WORKSPACE_MAX_THREADS 64
+
+// One .gitignore-style pattern
+struct _Rule {
+  char *pattern;
+  bool negate;   // "!pattern" brings back what an earlier rule excluded
+  bool dir_only; // "pattern/" only matches directories
+  bool anchored; // Matched against the path below base, not the name
+};
+
+// Patterns of one .gitignore, deeper files override their parents
+struct _Rules {
+  struct _Rules *parent;
+  size_t base_len; // Length of the directory of the .gitignore below root
+  struct _Rule *rules;
+  size_t count;
+  struct _Rules *next_alloc; // All rule sets, to free them at the end
+};
+
+// A directory waiting to be read
+struct _Dir {
+  char *path;
+  size_t rel; // Offset of the path below root inside path
+  struct _Rules *rules;
+  struct _Dir *next;
+};
+
+// State shared by the walker threads
+struct _Walk {
+  pthread_mutex_t lock;
+  pthread_cond_t wake;
+  struct _Dir *queue;
+  size_t busy; // Threads reading a directory, they may queue more
+  bool failed;
+  const char *name;
+  const struct Filter *filter;
+  struct Workspace *ws;
+  struct _Rules *rule_sets;
+};
+
+// Parse one line of a .gitignore into rule, false for blanks and comments
+bool _parse_rule(char *line, struct _Rule *rule) {
+  size_t len = strlen(line);
+  while (len > 0 && (line[len - 1] == ' ' || line[len - 1] == '\r')) {
+    line[--len] = '\0';
+  }
+  if (len == 0 || line[0] == '#') {
+    return false;
+  }
+
+  *rule = (struct _Rule){0};
+  if (line[0] == '!') {
+    rule->negate = true;
+    line++;
+    len--;
+  }
+  if (len > 0 && line[len - 1] == '/') {
+    rule->dir_only = true;
+    line[--len] = '\0';
+  }
+  // "dir/**" matches everything inside dir, pruning dir does the same
+  if (len >= 3 && strcmp(line + len - 3, "/**") == 0) {
+    line[len - 3] = '\0';
+    rule->dir_only = true;
+  }
+  // "**/name" matches name at any depth, like a pattern without a slash
+  while (strncmp(line, "**/", 3) == 0) {
+    line += 3;
+  }
+  if (line[0] == '/') {
+    rule->anchored = true;
+    line++;
+  }
+  if (line[0] == '\0') {
+    return false;
+  }
+
+  rule->anchored = rule->anchored || strchr(line, '/') != NULL;
+  rule->pattern = strdup(line);
+  return rule->pattern != NULL;
+}
+
+// Add a rule set for the directory base_len bytes below root, built from
+// the lines of text, NULL if there is no rule in it
+struct _Rules *_add_rules(struct _Walk *walk, struct _Rules *parent,
+                          size_t base_len, char *text) {
+  struct _Rules *set = calloc(1, sizeof(*set));
+  if (!set) {
+    return NULL;
+  }
+  set->parent = parent;
+  set->base_len = base_len;
+
+  size_t capacity = 0;
+  for (char *line = strtok(text, "\n"); line; line = strtok(NULL, "\n")) {
+    struct _Rule rule;
+    if (!_parse_rule(line, &rule)) {
+      continue;
+    }
+    if (set->count == capacity) {
+      capacity = capacity ? capacity * 2 : 8;
+      struct _Rule *rules = realloc(set->rules, capacity * sizeof(*rules));
+      if (!rules) {
+        free(rule.pattern);
+        break;
+      }
+      set->rules = rules;
+    }
+    set->rules[set->count++] = rule;
+  }
+
+  if (set->count == 0) {
+    free(set->rules);
+    free(set);
+    return NULL;
+  }
+
+  pthread_mutex_lock(&walk->lock);
+  set->next_alloc = walk->rule_sets;
+  walk->rule_sets = set;
+  pthread_mutex_unlock(&walk->lock);
+  return set;
+}
+
+// Rules of the .gitignore in the directory open at fd, or the parent's
+struct _Rules *_load_gitignore(struct _Walk *walk, int fd,
+                               struct _Rules *parent, size_t base_len) {
+  int file = openat(fd, ".gitignore", O_RDONLY | O_CLOEXEC);
+  if (file < 0) {
+    return parent;
+  }
+
+  struct stat st;
+  char *text = NULL;
+  if (fstat(file, &st) == 0 && (text = malloc(st.st_size + 1))) {
+    ssize_t n = pread(file, text, st.st_size, 0);
+    text[n > 0 ? n : 0] = '\0';
+    stats_add(STAT_BYTES_READ, n > 0 ? n : 0);
+  }
+  close(file);
+  stats_add(STAT_OPENS, 1);
+
+  struct _Rules *set = text ? _add_rules(walk, parent, base_len, text) : NULL;
+  free(text);
+  return set ? set : parent;
+}
+
+// True if rules exclude the entry rel (its path below root), whose name
+// starts at name
+bool _ignored(const struct _Rules *rules, const char *rel, const char *name,
+              bool is_dir) {
+  // The last matching pattern of the deepest .gitignore decides
+  for (; rules; rules = rules->parent) {
+    const char *below = rel + rules->base_len + (rules->base_len > 0);
+    for (size_t i = rules->count; i-- > 0;) {
+      const struct _Rule *rule = &rules->rules[i];
+      if (rule->dir_only && !is_dir) {
+        continue;
+      }
+      bool match = rule->anchored
+                       ? fnmatch(rule->pattern, below, FNM_PATHNAME) == 0
+                       : fnmatch(rule->pattern, name, 0) == 0;
+      if (match) {
+        return !rule->negate;
+      }
+    }
+  }
+  return false;
+}
+
+// Queue a directory for the walker threads
+bool _push_dir(struct _Walk *walk, char *path, size_t rel,
+               struct _Rules *rules) {
+  struct _Dir *dir = malloc(sizeof(*dir));
+  if (!dir) {
+    free(path);
+    return false;
+  }
+  *dir = (struct _Dir){.path = path, .rel = rel, .rules = rules};
+
+  pthread_mutex_lock(&walk->lock);
+  dir->next = walk->queue;
+  walk->queue = dir;
+  pthread_cond_signal(&walk->wake);
+  pthread_mutex_unlock(&walk->lock);
+  return true;
+}
+
+// Load the tasks of a found file and add it to the workspace
+bool _load_file(struct _Walk *walk, char *path) {
+  struct WorkspaceFile file = {.path = path};
+  if (!doc_load(&file.doc, path)) {
+    free(path);
+    return true; // Gone or unreadable, the rest of the tree still counts
+  }
+
+  // Every thread needs its own search state, the compiled regex is shared
+  struct Filter filter = *walk->filter;
+  filter.data = NULL;
+  bool ok = filter_active(&filter)
+                ? find_todos(&file.doc, &filter, &file.todos)
+                : load_todos(&file.doc, path, &file.todos);
+  if (!ok || file.todos.count == 0) {
+    if (ok) {
+      free_table(&file.todos);
+    }
+    doc_close(&file.doc);
+    free(path);
+    return ok;
+  }
+
+  pthread_mutex_lock(&walk->lock);
+  struct Workspace *ws = walk->ws;
+  if (ws->count == ws->capacity) {
+    size_t capacity = ws->capacity ? ws->capacity * 2 : 64;
+    struct WorkspaceFile *files =
+        realloc(ws->files, capacity * sizeof(*files));
+    if (!files) {
+      pthread_mutex_unlock(&walk->lock);
+      free_table(&file.todos);
+      doc_close(&file.doc);
+      free(path);
+      return false;
+    }
+    ws->files = files;
+    ws->capacity = capacity;
+  }
+  ws->files[ws->count++] = file;
+  ws->tasks += file.todos.count;
+  pthread_mutex_unlock(&walk->lock);
+  return true;
+}
+
+// Join a directory and an entry name, "." is left out
+char *_join(const char *dir, const char *name) {
+  if (strcmp(dir, ".") == 0) {
+    return strdup(name);
+  }
+  size_t len = strlen(dir);
+  const char *sep = len > 0 && dir[len - 1] == '/' ? "" : "/";
+  char *path;
+  return asprintf(&path, "%s%s%s", dir, sep, name) < 0 ? NULL : path;
+}
+
+// Part of path below the workspace root, empty for the root itself
+const char *_below_root(const char *path, size_t rel) {
+  return strlen(path) > rel ? path + rel : "";
+}
+
+// Read one directory: queue its subdirectories, load its TODO file
+bool _read_dir(struct _Walk *walk, struct _Dir *dir) {
+  int fd = open(dir->path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+  DIR *d = fd >= 0 ? fdopendir(fd) : NULL;
+  if (!d) {
+    if (fd >= 0) {
+      close(fd);
+    }
+    return true; // Unreadable directories are skipped like in git
+  }
+  stats_add(STAT_OPENS, 1);
+
+  size_t base_len = strlen(_below_root(dir->path, dir->rel));
+  struct _Rules *rules = _load_gitignore(walk, fd, dir->rules, base_len);
+
+  bool ok = true;
+  struct dirent *entry;
+  while (ok && (entry = readdir(d))) {
+    const char *name = entry->d_name;
+    if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0 ||
+        strcmp(name, ".git") == 0) {
+      continue;
+    }
+
+    bool is_dir = entry->d_type == DT_DIR;
+    bool is_file = entry->d_type == DT_REG;
+    if (entry->d_type == DT_UNKNOWN || entry->d_type == DT_LNK) {
+      struct stat st; // Symlinked files count, symlinked directories not
+      int flags = entry->d_type == DT_LNK ? 0 : AT_SYMLINK_NOFOLLOW;
+      if (fstatat(fd, name, &st, flags) != 0) {
+        continue;
+      }
+      is_dir = entry->d_type == DT_UNKNOWN && S_ISDIR(st.st_mode);
+      is_file = S_ISREG(st.st_mode);
+    }
+    if (!is_dir && (!is_file || strcmp(name, walk->name) != 0)) {
+      continue;
+    }
+
+    char *path = _join(dir->path, name);
+    if (!path) {
+      ok = false;
+      break;
+    }
+    if (_ignored(rules, path + dir->rel, name, is_dir)) {
+      free(path);
+      continue;
+    }
+
+    ok = is_dir ? _push_dir(walk, path, dir->rel, rules)
+                : _load_file(walk, path);
+  }
+
+  closedir(d);
+  return ok;
+}
+
+// Walker thread: take directories off the queue until the tree is done
+void *_walker(void *arg) {
+  struct _Walk *walk = arg;
+
+  pthread_mutex_lock(&walk->lock);
+  while (true) {
+    while (!walk->queue && walk->busy > 0) {
+      pthread_cond_wait(&walk->wake, &walk->lock);
+    }
+    struct _Dir *dir = walk->queue;
+    if (!dir) { // Nothing queued and nobody left to queue more
+      pthread_cond_broadcast(&walk->wake);
+      break;
+    }
+    walk->queue = dir->next;
+    walk->busy++;
+    pthread_mutex_unlock(&walk->lock);
+
+    bool ok = _read_dir(walk, dir);
+    free(dir->path);
+    free(dir);
+
+    pthread_mutex_lock(&walk->lock);
+    walk->failed = walk->failed || !ok;
+    walk->busy--;
+    if (!walk->queue && walk->busy == 0) {
+      pthread_cond_broadcast(&walk->wake);
+    }
+  }
+  pthread_mutex_unlock(&walk->lock);
+  return NULL;
+}
+
+// Order files by path so the output does not depend on thread timing
+int _compare_files(const void *a, const void *b) {
+  return strcmp(((const struct WorkspaceFile *)a)->path,
+                ((const struct WorkspaceFile *)b)->path);
+}
+
+// Find the files called name under root and load their tasks passing filter
+bool workspace_scan(struct Workspace *ws, const char *root, const char *name,
+                    const struct Filter *filter, char **excludes,
+                    size_t exclude_count) {
+  *ws = (struct Workspace){0};
+  struct stat st;
+  if (stat(root, &st) != 0) {
+    print_err(strerror(errno));
+    return false;
+  }
+  if (!S_ISDIR(st.st_mode)) {
+    print_err("Not a directory");
+    return false;
+  }
+
+  struct _Walk walk = {
+      .lock = PTHREAD_MUTEX_INITIALIZER,
+      .wake = PTHREAD_COND_INITIALIZER,
+      .name = name,
+      .filter = filter,
+      .ws = ws,
+  };
+
+  // Patterns given on the command line act as a .gitignore at the root
+  struct _Rules *rules = NULL;
+  for (size_t i = 0; i < exclude_count; i++) {
+    char *line = strdup(excludes[i]);
+    struct _Rules *set = line ? _add_rules(&walk, rules, 0, line) : NULL;
+    rules = set ? set : rules;
+    free(line);
+  }
+
+  // Every directory keeps the offset where paths below root start
+  char *start = strdup(root);
+  size_t rel = 0;
+  if (start && strcmp(start, ".") != 0) {
+    rel = strlen(start) + (start[strlen(start) - 1] != '/');
+  }
+  if (!start || !_push_dir(&walk, start, rel, rules)) {
+    print_err("Memory allocation failed");
+    return false;
+  }
+
+  long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+  size_t threads = cpus > WORKSPACE_MIN_THREADS ? cpus : WORKSPACE_MIN_THREADS;
+  threads = threads < WORKSPACE_MAX_THREADS ? threads : WORKSPACE_MAX_THREADS;
+  pthread_t ids[WORKSPACE_MAX_THREADS];
+  size_t started = 0;
+  while (started < threads &&
+         pthread_create(&ids[started], NULL, _walker, &walk) == 0) {
+    started++;
+  }
+  if (started == 0) {
+    _walker(&walk);
+  }
+  for (size_t i = 0; i < started; i++) {
+    pthread_join(ids[i], NULL);
+  }
+
+  while (walk.rule_sets) {
+    struct _Rules *set = walk.rule_sets;
+    walk.rule_sets = set->next_alloc;
+    for (size_t i = 0; i < set->count; i++) {
+      free(set->rules[i].pattern);
+    }
+    free(set->rules);
+    free(set);
+  }
+
+  qsort(ws->files, ws->count, sizeof(*ws->files), _compare_files);
+  if (walk.failed) {
+    print_err("Memory allocation failed");
+    workspace_free(ws);
+    return false;
+  }
+  return true;
+}
+
+// Release the files of a workspace
+void workspace_free(struct Workspace *ws) {
+  for (size_t i = 0; i < ws->count; i++) {
+    free_table(&ws->files[i].todos);
+    doc_close(&ws->files[i].doc);
+    free(ws->files[i].path);
+  }
+  free(ws->files);
+  *ws = (struct Workspace){0};
+}
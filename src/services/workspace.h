@@ -0,0 +1,60 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2025 Võ Quang Chiến
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef WORKSPACE_H
+#define WORKSPACE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "filter.h"
+#include "storage.h"
+
+// A TODO file found under a workspace root
+struct WorkspaceFile {
+  char *path; // Root joined with the path below it
+  struct Document doc;
+  struct TodoTable todos; // Tasks passing the filter, with their IDs
+};
+
+// Every TODO file of a directory tree, sorted by path
+struct Workspace {
+  struct WorkspaceFile *files;
+  size_t count;
+  size_t capacity;
+  size_t tasks; // Sum of the task counts
+};
+
+// Find the files called name under root and load their tasks passing
+// filter, walking directories and parsing files on a pool of threads.
+// Directories called .git, what .gitignore files rule out and the
+// .gitignore-style patterns in excludes are skipped.
+bool workspace_scan(struct Workspace *ws, const char *root, const char *name,
+                    const struct Filter *filter, char **excludes,
+                    size_t exclude_count);
+
+// Release the files of a workspace
+void workspace_free(struct Workspace *ws);
+
+#endif
@@ -0,0 +1,378 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2025 Võ Quang Chiến
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "writer.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "../utils/fmt.h"
+#include "../utils/stats.h"
+
+// Constants
+#define WRITER_BUFFER_SIZE (1 << 20)
+#define WRITER_COPY_MIN (64 * 1024)
+#define TEMP_SUFFIX ".XXXXXX"
+
+// Parse a durability name (none, file, dir)
+bool parse_durability(const char *name, enum Durability *out) {
+  if (strcmp(name, "none") == 0) {
+    *out = DURABILITY_NONE;
+  } else if (strcmp(name, "file") == 0) {
+    *out = DURABILITY_FILE;
+  } else if (strcmp(name, "dir") == 0) {
+    *out = DURABILITY_DIR;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+// Build "<dir>/.<base>.XXXXXX" so the rename never crosses filesystems
+char *_temp_template(const char *file_path) {
+  const char *slash = strrchr(file_path, '/');
+  size_t dir_len = slash ? (size_t)(slash - file_path) + 1 : 0;
+  const char *base = file_path + dir_len;
+
+  size_t size = strlen(file_path) + sizeof(TEMP_SUFFIX) + 1;
+  char *tmp = malloc(size);
+  if (!tmp) {
+    return NULL;
+  }
+  snprintf(tmp, size, "%.*s.%s" TEMP_SUFFIX, (int)dir_len, file_path, base);
+  return tmp;
+}
+
+// Give the temp file the permissions the target has (or would get)
+void _copy_mode(int fd, const char *file_path) {
+  struct stat st;
+  if (stat(file_path, &st) == 0) {
+    fchmod(fd, st.st_mode & 07777);
+    return;
+  }
+
+  mode_t mask = umask(0);
+  umask(mask);
+  fchmod(fd, 0666 & ~mask);
+}
+
+// Create the temp file for a new version of file_path
+bool writer_open(struct Writer *w, const char *file_path,
+                 enum Durability durability) {
+  memset(w, 0, sizeof(*w));
+  w->fd = -1;
+  w->durability = durability;
+  w->last = '\n';
+
+  w->path = strdup(file_path);
+  w->tmp_path = _temp_template(file_path);
+  w->buffer = malloc(WRITER_BUFFER_SIZE);
+  if (!w->path || !w->tmp_path || !w->buffer) {
+    print_err("Memory allocation failed");
+    writer_abort(w);
+    return false;
+  }
+
+  w->fd = mkstemp(w->tmp_path);
+  if (w->fd < 0) {
+    print_err(strerror(errno));
+    free(w->tmp_path);
+    w->tmp_path = NULL;
+    writer_abort(w);
+    return false;
+  }
+
+  stats_add(STAT_OPENS, 1);
+  _copy_mode(w->fd, file_path);
+  return true;
+}
+
+// Build a document in an anonymous memory file instead, see writer_finish
+bool writer_open_memory(struct Writer *w) {
+  memset(w, 0, sizeof(*w));
+  w->last = '\n';
+  w->buffer = malloc(WRITER_BUFFER_SIZE);
+  w->fd = w->buffer ? memfd_create("td", MFD_CLOEXEC) : -1;
+  if (w->fd < 0) {
+    print_err(w->buffer ? strerror(errno) : "Memory allocation failed");
+    writer_abort(w);
+    return false;
+  }
+  return true;
+}
+
+// Write the whole range, retrying on short writes
+bool _write_all(int fd, const char *data, size_t len) {
+  stats_add(STAT_BYTES_WRITTEN, len);
+  while (len > 0) {
+    ssize_t n = write(fd, data, len);
+    if (n < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    data += n;
+    len -= n;
+  }
+  return true;
+}
+
+// Push buffered bytes to the temp file
+bool _writer_flush(struct Writer *w) {
+  if (w->failed) {
+    return false;
+  }
+  if (w->len > 0 && !_write_all(w->fd, w->buffer, w->len)) {
+    print_err(strerror(errno));
+    w->failed = true;
+    return false;
+  }
+  w->len = 0;
+  return true;
+}
+
+// Append bytes to the new document
+bool writer_write(struct Writer *w, const void *data, size_t len) {
+  if (w->failed) {
+    return false;
+  }
+  if (len == 0) {
+    return true;
+  }
+
+  w->last = ((const char *)data)[len - 1];
+
+  if (w->len + len > WRITER_BUFFER_SIZE) {
+    if (!_writer_flush(w)) {
+      return false;
+    }
+    // Large chunks skip the buffer entirely
+    if (len >= WRITER_BUFFER_SIZE) {
+      if (!_write_all(w->fd, data, len)) {
+        print_err(strerror(errno));
+        w->failed = true;
+        return false;
+      }
+      return true;
+    }
+  }
+
+  memcpy(w->buffer + w->len, data, len);
+  w->len += len;
+  return true;
+}
+
+// Append a string to the new document
+bool writer_puts(struct Writer *w, const char *s) {
+  return writer_write(w, s, strlen(s));
+}
+
+// Copy through userspace when the kernel cannot copy between these files
+bool _copy_by_hand(struct Writer *w, int fd, off_t offset, size_t len) {
+  while (len > 0) {
+    size_t room = WRITER_BUFFER_SIZE - w->len;
+    if (room == 0) {
+      if (!_writer_flush(w)) {
+        return false;
+      }
+      room = WRITER_BUFFER_SIZE;
+    }
+
+    size_t chunk = len < room ? len : room;
+    ssize_t n = pread(fd, w->buffer + w->len, chunk, offset);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      print_err(n < 0 ? strerror(errno) : "Unexpected end of file");
+      w->failed = true;
+      return false;
+    }
+    stats_add(STAT_BYTES_READ, n);
+    w->len += n;
+    offset += n;
+    len -= n;
+  }
+  return true;
+}
+
+// Append len bytes of fd starting at offset, copied inside the kernel
+bool writer_copy(struct Writer *w, int fd, off_t offset, size_t len) {
+  if (len == 0) {
+    return !w->failed;
+  }
+
+  // Small spans are cheaper to batch in the buffer than to syscall for
+  if (len < WRITER_COPY_MIN) {
+    return _copy_by_hand(w, fd, offset, len) &&
+           pread(fd, &w->last, 1, offset + len - 1) == 1;
+  }
+
+  if (!_writer_flush(w) || pread(fd, &w->last, 1, offset + len - 1) != 1) {
+    w->failed = true;
+    return false;
+  }
+
+  while (len > 0) {
+    off_t in = offset;
+    ssize_t n = copy_file_range(fd, &in, w->fd, NULL, len, 0);
+    if (n < 0 && (errno == EXDEV || errno == ENOSYS || errno == EINVAL ||
+                  errno == EOPNOTSUPP)) {
+      in = offset;
+      n = sendfile(w->fd, fd, &in, len);
+    }
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n < 0) {
+      return _copy_by_hand(w, fd, offset, len) && _writer_flush(w);
+    }
+    if (n == 0) {
+      print_err("Unexpected end of file");
+      w->failed = true;
+      return false;
+    }
+    stats_add(STAT_BYTES_WRITTEN, n);
+    offset += n;
+    len -= n;
+  }
+  return true;
+}
+
+// fsync the directory holding path so the rename itself is durable
+bool sync_parent(const char *file_path) {
+  const char *slash = strrchr(file_path, '/');
+  char *dir = slash ? strndup(file_path, slash - file_path + 1) : strdup(".");
+  if (!dir) {
+    return false;
+  }
+
+  int fd = open(dir, O_RDONLY | O_DIRECTORY);
+  free(dir);
+  if (fd < 0) {
+    return false;
+  }
+
+  stats_add(STAT_FSYNCS, 1);
+  bool ok = fsync(fd) == 0;
+  close(fd);
+  return ok;
+}
+
+// Flush, sync and rename, the body of writer_commit
+bool _commit(struct Writer *w) {
+  if (!_writer_flush(w)) {
+    writer_abort(w);
+    return false;
+  }
+
+  stats_add(STAT_FSYNCS, w->durability >= DURABILITY_FILE);
+  if (w->durability >= DURABILITY_FILE && fsync(w->fd) != 0) {
+    print_err(strerror(errno));
+    writer_abort(w);
+    return false;
+  }
+
+  // Nothing writes to the new file after this, it is what an index of it
+  // gets stamped with
+  if (fstat(w->fd, &w->st) != 0) {
+    print_err(strerror(errno));
+    writer_abort(w);
+    return false;
+  }
+
+  if (close(w->fd) != 0) {
+    w->fd = -1;
+    print_err(strerror(errno));
+    writer_abort(w);
+    return false;
+  }
+  w->fd = -1;
+
+  // rename() replaces the target atomically, readers see old or new file
+  stats_add(STAT_RENAMES, 1);
+  if (rename(w->tmp_path, w->path) != 0) {
+    print_err(strerror(errno));
+    writer_abort(w);
+    return false;
+  }
+
+  bool ok = true;
+  if (w->durability >= DURABILITY_DIR && !sync_parent(w->path)) {
+    print_err(strerror(errno));
+    ok = false;
+  }
+
+  free(w->tmp_path);
+  w->tmp_path = NULL;
+  writer_abort(w);
+  return ok;
+}
+
+// Flush, sync and atomically rename the new document over the target
+bool writer_commit(struct Writer *w) {
+  size_t span = stats_begin("commit");
+  bool ok = _commit(w);
+  stats_end(span);
+  return ok;
+}
+
+// Flush an in-memory writer and hand over its descriptor, -1 on failure
+int writer_finish(struct Writer *w) {
+  int fd = -1;
+  if (_writer_flush(w)) {
+    fd = w->fd;
+    w->fd = -1;
+  }
+  writer_abort(w);
+  return fd;
+}
+
+// Drop the new document and remove the temp file
+void writer_abort(struct Writer *w) {
+  if (w->fd >= 0) {
+    close(w->fd);
+    w->fd = -1;
+  }
+  if (w->tmp_path) {
+    unlink(w->tmp_path);
+  }
+
+  free(w->tmp_path);
+  free(w->path);
+  free(w->buffer);
+  w->tmp_path = NULL;
+  w->path = NULL;
+  w->buffer = NULL;
+  w->len = 0;
+}
@@ -0,0 +1,85 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2025 Võ Quang Chiến
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef WRITER_H
+#define WRITER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+// How hard a commit tries to reach stable storage before returning
+enum Durability {
+  DURABILITY_NONE, // Rename only, rely on the page cache
+  DURABILITY_FILE, // fsync the new file before renaming it
+  DURABILITY_DIR,  // Also fsync the parent directory after the rename
+};
+
+// Buffered writer that builds a new document in a temp file next to the
+// target and atomically replaces the target on commit
+struct Writer {
+  int fd;
+  char *path;     // Target file
+  char *tmp_path; // Unique temp file in the target's directory
+  enum Durability durability;
+  char *buffer;
+  size_t len;
+  bool failed;
+  char last; // Last byte written, used to keep tasks on their own line
+  struct stat st; // Identity of the new file, set by writer_commit
+};
+
+// Parse a durability name (none, file, dir)
+bool parse_durability(const char *name, enum Durability *out);
+
+// Create the temp file for a new version of file_path
+bool writer_open(struct Writer *w, const char *file_path,
+                 enum Durability durability);
+
+// Build a document in an anonymous memory file instead, see writer_finish
+bool writer_open_memory(struct Writer *w);
+
+// Append bytes to the new document
+bool writer_write(struct Writer *w, const void *data, size_t len);
+
+// Append a string to the new document
+bool writer_puts(struct Writer *w, const char *s);
+
+// Append len bytes of fd starting at offset, copied inside the kernel
+bool writer_copy(struct Writer *w, int fd, off_t offset, size_t len);
+
+// Flush, sync and atomically rename the new document over the target
+bool writer_commit(struct Writer *w);
+
+// Flush an in-memory writer and hand over its descriptor, -1 on failure
+int writer_finish(struct Writer *w);
+
+// fsync the directory holding path so a new name in it is durable
+bool sync_parent(const char *file_path);
+
+// Drop the new document and remove the temp file
+void writer_abort(struct Writer *w);
+
+#endif
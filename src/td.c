@@ -0,0 +1,216 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2025 Võ Quang Chiến
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "td.h"
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "services/batch.h"
+#include "services/selector.h"
+#include "utils/fmt.h"
+
+struct TdDocument {
+  struct Batch batch;
+};
+
+// Status for a failure, from what the storage layer left in errno
+static int _status(int err) {
+  switch (err) {
+  case ENOENT:
+    return TD_ERR_NOT_FOUND;
+  case ENOMEM:
+    return TD_ERR_NOMEM;
+  case EAGAIN:
+    return TD_ERR_CONFLICT;
+  default:
+    return TD_ERR_IO;
+  }
+}
+
+// Open and parse path, *out is set on success
+static int _open(const char *path, struct TdDocument **out) {
+  *out = NULL;
+  if (!path) {
+    return TD_ERR_INVALID;
+  }
+
+  struct TdDocument *doc = malloc(sizeof(*doc));
+  if (!doc) {
+    return TD_ERR_NOMEM;
+  }
+
+  errno = 0;
+  if (!batch_open(&doc->batch, path)) {
+    int err = errno;
+    free(doc);
+    return _status(err);
+  }
+  *out = doc;
+  return TD_OK;
+}
+
+// Open and parse path, *out is set on success
+int td_open(const char *path, struct TdDocument **out) {
+  // Every call into the storage layer runs in a quiet scope, the host's
+  // own error output is left as it was
+  quiet_errors_begin();
+  int status = _open(path, out);
+  quiet_errors_end();
+  return status;
+}
+
+// Number of tasks, pending edits included
+size_t td_count(const struct TdDocument *doc) {
+  return batch_count(&doc->batch);
+}
+
+// Task with ID id (from 1 to td_count), pending edits included
+int td_get(const struct TdDocument *doc, uint32_t id, struct TdTask *out) {
+  struct BatchTask task;
+  if (!batch_get(&doc->batch, id, &task)) {
+    return TD_ERR_INVALID;
+  }
+  *out = (struct TdTask){
+      .id = id, .text = task.text, .length = task.length, .done = task.is_done};
+  return TD_OK;
+}
+
+// Append a task
+int td_add(struct TdDocument *doc, const char *text, bool done) {
+  if (!text || strchr(text, '\n')) {
+    return TD_ERR_INVALID;
+  }
+  quiet_errors_begin();
+  bool ok = batch_add(&doc->batch, text, done);
+  quiet_errors_end();
+  return ok ? TD_OK : TD_ERR_NOMEM;
+}
+
+// Apply a selector based edit
+static int _edit(struct TdDocument *doc, const char *selector, bool remove,
+                 bool done) {
+  if (!selector) {
+    return TD_ERR_INVALID;
+  }
+
+  quiet_errors_begin();
+  struct Selector sel;
+  int status = TD_ERR_INVALID;
+  if (selector_parse(&sel, selector)) {
+    bool ok = remove ? batch_remove(&doc->batch, &sel)
+                     : batch_set_status(&doc->batch, &sel, done);
+    selector_free(&sel);
+    status = ok ? TD_OK : TD_ERR_NOMEM;
+  }
+  quiet_errors_end();
+  return status;
+}
+
+// Mark the tasks a selector such as "1,4-6,open" matches
+int td_set_status(struct TdDocument *doc, const char *selector, bool done) {
+  return _edit(doc, selector, false, done);
+}
+
+// Remove the tasks a selector matches, later tasks move up
+int td_remove(struct TdDocument *doc, const char *selector) {
+  return _edit(doc, selector, true, false);
+}
+
+// Remove every task, the rest of the document is kept
+int td_clear(struct TdDocument *doc) {
+  batch_clear(&doc->batch);
+  return TD_OK;
+}
+
+// Drop pending edits and parse the file again
+int td_reload(struct TdDocument *doc) {
+  struct Batch fresh;
+  errno = 0;
+  quiet_errors_begin();
+  bool ok = batch_open(&fresh, doc->batch.path);
+  int err = errno;
+  quiet_errors_end();
+  if (!ok) {
+    return _status(err);
+  }
+  batch_close(&doc->batch);
+  doc->batch = fresh;
+  return TD_OK;
+}
+
+// Write pending edits with one atomic replace, then reload the document.
+// Once the replace has landed the edits are no longer pending, so a failed
+// reload still returns TD_OK and leaves the handle needing td_reload.
+int td_commit(struct TdDocument *doc, enum TdSync sync) {
+  if (sync > TD_SYNC_DIR) {
+    return TD_ERR_INVALID;
+  }
+  if (doc->batch.changes == 0) {
+    return TD_OK;
+  }
+
+  errno = 0;
+  quiet_errors_begin();
+  bool ok = batch_commit(&doc->batch, (enum Durability)sync);
+  int err = errno;
+  quiet_errors_end();
+  if (!ok) {
+    return _status(err);
+  }
+  td_reload(doc);
+  return TD_OK;
+}
+
+// Close the document, pending edits are dropped
+void td_close(struct TdDocument *doc) {
+  if (doc) {
+    batch_close(&doc->batch);
+    free(doc);
+  }
+}
+
+// Short description of a status
+const char *td_strerror(int status) {
+  switch (status) {
+  case TD_OK:
+    return "Success";
+  case TD_ERR_INVALID:
+    return "Invalid argument";
+  case TD_ERR_NOT_FOUND:
+    return "File not found";
+  case TD_ERR_IO:
+    return "I/O error";
+  case TD_ERR_NOMEM:
+    return "Out of memory";
+  case TD_ERR_CONFLICT:
+    return "File changed since it was opened";
+  default:
+    return "Unknown error";
+  }
+}
+
+// Message of the last failure on this thread
+const char *td_last_error(void) { return last_error(); }
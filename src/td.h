@@ -0,0 +1,114 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2025 Võ Quang Chiến
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+// libtd: open a TODO.md once, query and edit it many times, then commit.
+// Every call returns a TdStatus, nothing is printed.
+
+#ifndef TD_H
+#define TD_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define TD_API __attribute__((visibility("default")))
+
+// Result of a libtd call, td_last_error() has the details of a failure
+enum TdStatus {
+  TD_OK = 0,
+  TD_ERR_INVALID = -1,   // Bad argument, selector or task ID
+  TD_ERR_NOT_FOUND = -2, // The file does not exist
+  TD_ERR_IO = -3,
+  TD_ERR_NOMEM = -4,
+  TD_ERR_CONFLICT = -5, // The file changed since it was opened, reload
+};
+
+// How hard td_commit tries to reach stable storage
+enum TdSync {
+  TD_SYNC_NONE, // Atomic rename only
+  TD_SYNC_FILE, // fsync the new file first
+  TD_SYNC_DIR,  // Also fsync the directory after the rename
+};
+
+// A task, text is not NUL terminated and stays valid until the next
+// td_commit, td_reload or td_close
+struct TdTask {
+  uint32_t id;
+  const char *text;
+  size_t length;
+  bool done;
+};
+
+// An open document
+struct TdDocument;
+
+// Open and parse path, *out is set on success
+TD_API int td_open(const char *path, struct TdDocument **out);
+
+// Number of tasks, pending edits included
+TD_API size_t td_count(const struct TdDocument *doc);
+
+// Task with ID id (from 1 to td_count), pending edits included
+TD_API int td_get(const struct TdDocument *doc, uint32_t id,
+                  struct TdTask *out);
+
+// Append a task
+TD_API int td_add(struct TdDocument *doc, const char *text, bool done);
+
+// Mark the tasks a selector such as "1,4-6,open" matches
+TD_API int td_set_status(struct TdDocument *doc, const char *selector,
+                         bool done);
+
+// Remove the tasks a selector matches, later tasks move up
+TD_API int td_remove(struct TdDocument *doc, const char *selector);
+
+// Remove every task, the rest of the document is kept
+TD_API int td_clear(struct TdDocument *doc);
+
+// Write pending edits with one atomic replace, then reload the document.
+// TD_OK means the edits are in the file. If only the reload failed, the
+// handle still shows them and needs td_reload before further edits.
+TD_API int td_commit(struct TdDocument *doc, enum TdSync sync);
+
+// Drop pending edits and parse the file again
+TD_API int td_reload(struct TdDocument *doc);
+
+// Close the document, pending edits are dropped
+TD_API void td_close(struct TdDocument *doc);
+
+// Short description of a status
+TD_API const char *td_strerror(int status);
+
+// Message of the last failure on this thread
+TD_API const char *td_last_error(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
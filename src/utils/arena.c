@@ -0,0 +1,78 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2025 Võ Quang Chiến
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "arena.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "stats.h"
+
+// Constants
+#define ARENA_MIN_BLOCK (64 * 1024)
+#define ARENA_MAX_BLOCK (64 * 1024 * 1024)
+#define ARENA_ALIGN 16
+
+// Allocate size bytes aligned to 16, return NULL if out of memory
+void *arena_alloc(struct Arena *arena, size_t size) {
+  size = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+
+  struct ArenaBlock *block = arena->head;
+  if (!block || block->size - block->used < size) {
+    // Blocks double in size so a growing table needs few of them
+    size_t block_size = block ? block->size * 2 : ARENA_MIN_BLOCK;
+    if (block_size > ARENA_MAX_BLOCK) {
+      block_size = ARENA_MAX_BLOCK;
+    }
+    if (block_size < size) {
+      block_size = size;
+    }
+
+    block = malloc(sizeof(struct ArenaBlock) + block_size);
+    if (!block) {
+      return NULL;
+    }
+    stats_add(STAT_ARENA_BLOCKS, 1);
+    stats_add(STAT_ARENA_BYTES, block_size);
+    block->next = arena->head;
+    block->size = block_size;
+    block->used = 0;
+    arena->head = block;
+  }
+
+  void *ptr = block->data + block->used;
+  block->used += size;
+  return ptr;
+}
+
+// Release every allocation made from the arena at once
+void arena_free(struct Arena *arena) {
+  struct ArenaBlock *block = arena->head;
+  while (block) {
+    struct ArenaBlock *next = block->next;
+    free(block);
+    block = next;
+  }
+  arena->head = NULL;
+}
@@ -0,0 +1,86 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2025 Võ Quang Chiến
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef BITMAP_H
+#define BITMAP_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Number of 64-bit words needed to hold n bits
+#define BITMAP_WORDS(n) (((n) + 63) / 64)
+
+// Read bit i
+static inline bool bitmap_get(const uint64_t *bits, size_t i) {
+  return (bits[i / 64] >> (i % 64)) & 1;
+}
+
+// Set bit i
+static inline void bitmap_set(uint64_t *bits, size_t i) {
+  bits[i / 64] |= (uint64_t)1 << (i % 64);
+}
+
+// Clear bit i
+static inline void bitmap_clear(uint64_t *bits, size_t i) {
+  bits[i / 64] &= ~((uint64_t)1 << (i % 64));
+}
+
+// Set bit i to value
+static inline void bitmap_put(uint64_t *bits, size_t i, bool value) {
+  if (value) {
+    bitmap_set(bits, i);
+  } else {
+    bitmap_clear(bits, i);
+  }
+}
+
+// Set bits [from, to)
+static inline void bitmap_set_range(uint64_t *bits, size_t from, size_t to) {
+  while (from < to && from % 64 != 0) {
+    bitmap_set(bits, from++);
+  }
+  for (; from + 64 <= to; from += 64) {
+    bits[from / 64] = ~(uint64_t)0;
+  }
+  while (from < to) {
+    bitmap_set(bits, from++);
+  }
+}
+
+// Index of the first set bit at or after from, or count if there is none
+static inline size_t bitmap_next(const uint64_t *bits, size_t from,
+                                 size_t count) {
+  while (from < count) {
+    uint64_t word = bits[from / 64] >> (from % 64);
+    if (word) {
+      from += __builtin_ctzll(word);
+      return from < count ? from : count;
+    }
+    from = (from / 64 + 1) * 64;
+  }
+  return count;
+}
+
+#endif
@@ -25,13 +25,34 @@
 #include "fmt.h"
 
 #include <stdarg.h>
+#include <stdbool.h>
 #include <stdio.h>
 
-// Print error message to stderr
+static int quiet_depth; // Open quiet scopes, updated atomically
+static _Thread_local char last_message[256];
+
+// Print error message to stderr, and keep it for last_error
 void print_err(const char *message) {
-  fprintf(stderr, "%s: %s", COLOR_RED "[ERROR]" STYLE_RESET, message);
+  snprintf(last_message, sizeof(last_message), "%s", message);
+  if (__atomic_load_n(&quiet_depth, __ATOMIC_RELAXED) == 0) {
+    fprintf(stderr, "%s: %s", COLOR_RED "[ERROR]" STYLE_RESET, message);
+  }
+}
+
+// Stop printing errors until the matching quiet_errors_end, they are only
+// kept for last_error. Scopes nest and cover every thread (used by libtd).
+void quiet_errors_begin(void) {
+  __atomic_fetch_add(&quiet_depth, 1, __ATOMIC_RELAXED);
 }
 
+// Close a scope of quiet_errors_begin
+void quiet_errors_end(void) {
+  __atomic_fetch_sub(&quiet_depth, 1, __ATOMIC_RELAXED);
+}
+
+// Last message given to print_err on this thread, empty if none
+const char *last_error(void) { return last_message; }
+
 // Print info message
 void print_info(const char *format, ...) {
   va_list args;
@@ -25,6 +25,8 @@
 #ifndef FMT_H
 #define FMT_H
 
+#include <stdbool.h>
+
 // Foreground colors
 #define COLOR_BLACK "\033[0;30m"
 #define COLOR_RED "\033[0;31m"
@@ -65,9 +67,19 @@
 #define RIGHT_MID "\xe2\x94\xa4"    // ┤
 #define CROSS "\xe2\x94\xbc"        // ┼
 
-// Print error message to stderr
+// Print error message to stderr, and keep it for last_error
 void print_err(const char *message);
 
+// Stop printing errors until the matching quiet_errors_end, they are only
+// kept for last_error. Scopes nest and cover every thread (used by libtd).
+void quiet_errors_begin(void);
+
+// Close a scope of quiet_errors_begin
+void quiet_errors_end(void);
+
+// Last message given to print_err on this thread, empty if none
+const char *last_error(void);
+
 // Print info message
 void print_info(const char *format, ...);
 
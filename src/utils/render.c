@@ -0,0 +1,435 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2025 Võ Quang Chiến
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "render.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+#include "fmt.h"
+
+// Constants
+#define RENDER_INITIAL_SIZE (64 * 1024)
+#define RENDER_ROW_EXTRA 64 // Borders, marks and styles around the text
+#define BORDER_BYTES 3      // Every box-drawing character is 3 bytes long
+#define RENDER_FLUSH_SIZE (256 * 1024) // Streamed tables write out this often
+#define STREAM_TASK_WIDTH 60 // Task column of a streamed table off a terminal,
+                             // wider tasks overflow it
+#define ELLIPSIS "\xe2\x80\xa6" // …
+
+// Number of decimal digits of n
+int num_digits(uint32_t n) {
+  int digits = 1;
+  while (n >= 10) {
+    n /= 10;
+    digits++;
+  }
+  return digits;
+}
+
+// Zero-width code points: combining marks, joiners and variation selectors
+bool _is_zero_width(uint32_t c) {
+  return (c >= 0x0300 && c <= 0x036f) || (c >= 0x0483 && c <= 0x0489) ||
+         (c >= 0x0591 && c <= 0x05bd) || (c >= 0x0610 && c <= 0x061a) ||
+         (c >= 0x064b && c <= 0x065f) || (c >= 0x0e31 && c <= 0x0e3a &&
+                                          c != 0x0e32 && c != 0x0e33) ||
+         (c >= 0x0e47 && c <= 0x0e4e) || (c >= 0x1ab0 && c <= 0x1aff) ||
+         (c >= 0x1dc0 && c <= 0x1dff) || (c >= 0x200b && c <= 0x200f) ||
+         (c >= 0x20d0 && c <= 0x20ff) || (c >= 0xfe00 && c <= 0xfe0f) ||
+         (c >= 0xfe20 && c <= 0xfe2f) || c == 0xfeff ||
+         (c >= 0xe0100 && c <= 0xe01ef);
+}
+
+// Double-width code points: East Asian wide and fullwidth forms, emoji
+bool _is_wide(uint32_t c) {
+  return (c >= 0x1100 && c <= 0x115f) || (c >= 0x2e80 && c <= 0x303e) ||
+         (c >= 0x3041 && c <= 0x33ff) || (c >= 0x3400 && c <= 0x4dbf) ||
+         (c >= 0x4e00 && c <= 0x9fff) || (c >= 0xa000 && c <= 0xa4cf) ||
+         (c >= 0xac00 && c <= 0xd7a3) || (c >= 0xf900 && c <= 0xfaff) ||
+         (c >= 0xfe30 && c <= 0xfe4f) || (c >= 0xff00 && c <= 0xff60) ||
+         (c >= 0xffe0 && c <= 0xffe6) || (c >= 0x1f300 && c <= 0x1f64f) ||
+         (c >= 0x1f900 && c <= 0x1f9ff) || (c >= 0x20000 && c <= 0x3fffd);
+}
+
+// Columns taken by the longest prefix of text that fits in limit columns,
+// its length in bytes goes to fit
+size_t _measure(const char *text, size_t len, size_t limit, size_t *fit) {
+  const unsigned char *p = (const unsigned char *)text;
+  const unsigned char *end = p + len;
+  size_t width = 0;
+
+  while (p < end) {
+    // Printable ASCII is the common case, take it eight bytes at a time
+    if (end - p >= 8 && limit - width >= 8) {
+      uint64_t word;
+      memcpy(&word, p, sizeof(word));
+      const uint64_t high = 0x8080808080808080ull;
+      const uint64_t space = 0x2020202020202020ull;
+      if (((word | (word - space)) & high) == 0) {
+        width += 8;
+        p += 8;
+        continue;
+      }
+    }
+
+    if (*p < 0x80) { // Control characters take no column
+      if (*p >= 0x20 && width == limit) {
+        break;
+      }
+      width += *p >= 0x20;
+      p++;
+      continue;
+    }
+
+    uint32_t c;
+    int extra;
+    if ((*p & 0xe0) == 0xc0) {
+      c = *p & 0x1f;
+      extra = 1;
+    } else if ((*p & 0xf0) == 0xe0) {
+      c = *p & 0x0f;
+      extra = 2;
+    } else if ((*p & 0xf8) == 0xf0) {
+      c = *p & 0x07;
+      extra = 3;
+    } else { // Stray continuation or invalid lead byte
+      c = 0xfffd;
+      extra = 0;
+    }
+
+    bool valid = end - p > extra;
+    for (int i = 1; valid && i <= extra; i++) {
+      valid = (p[i] & 0xc0) == 0x80;
+      c = (c << 6) | (p[i] & 0x3f);
+    }
+    if (!valid) { // Show the lead byte as one replacement character
+      c = 0xfffd;
+      extra = 0;
+    }
+
+    size_t columns = _is_zero_width(c) ? 0 : _is_wide(c) ? 2 : 1;
+    if (width + columns > limit) {
+      break;
+    }
+    p += extra + 1;
+    width += columns;
+  }
+
+  *fit = p - (const unsigned char *)text;
+  return width;
+}
+
+// Terminal columns taken by len bytes of UTF-8 text
+size_t display_width(const char *text, size_t len) {
+  size_t fit;
+  return _measure(text, len, SIZE_MAX, &fit);
+}
+
+// Make room for n more bytes
+bool _reserve(struct Render *r, size_t n) {
+  if (r->len + n <= r->cap) {
+    return true;
+  }
+
+  size_t cap = r->cap ? r->cap : RENDER_INITIAL_SIZE;
+  while (cap < r->len + n) {
+    cap *= 2;
+  }
+  char *grown = realloc(r->data, cap);
+  if (!grown) {
+    r->failed = true;
+    return false;
+  }
+  r->data = grown;
+  r->cap = cap;
+  return true;
+}
+
+// Append bytes, the caller reserved room
+static inline void _put(struct Render *r, const char *s, size_t n) {
+  memcpy(r->data + r->len, s, n);
+  r->len += n;
+}
+
+// Append n spaces, the caller reserved room
+static inline void _pad(struct Render *r, int n) {
+  if (n > 0) {
+    memset(r->data + r->len, ' ', n);
+    r->len += n;
+  }
+}
+
+// Append a style, dropped when the output is not a terminal
+static inline void _style(struct Render *r, const char *s, size_t n) {
+  if (r->styled) {
+    _put(r, s, n);
+  }
+}
+
+#define PUT(r, s) _put(r, s, sizeof(s) - 1)
+#define STYLE(r, s) _style(r, s, sizeof(s) - 1)
+
+// Append a run of width horizontal lines, doubling what is already there
+void _h_run(struct Render *r, int width) {
+  if (width <= 0) {
+    return;
+  }
+
+  char *run = r->data + r->len;
+  size_t total = (size_t)width * BORDER_BYTES;
+  size_t done = BORDER_BYTES;
+  memcpy(run, H_LINE, BORDER_BYTES);
+  while (done < total) {
+    size_t n = done < total - done ? done : total - done;
+    memcpy(run + done, run, n);
+    done += n;
+  }
+  r->len += total;
+}
+
+// Append a border row
+void _border(struct Render *r, const char *left, const char *mid,
+             const char *right) {
+  int width = r->id_width + r->task_width + r->done_width;
+  if (!_reserve(r, (size_t)(width + 4) * BORDER_BYTES + 1)) {
+    return;
+  }
+
+  _put(r, left, BORDER_BYTES);
+  _h_run(r, r->id_width);
+  _put(r, mid, BORDER_BYTES);
+  _h_run(r, r->task_width);
+  _put(r, mid, BORDER_BYTES);
+  _h_run(r, r->done_width);
+  _put(r, right, BORDER_BYTES);
+  PUT(r, "\n");
+}
+
+// Start a table with columns of the given widths and draw the header
+bool _begin(struct Render *r, int fd, int id_width, size_t max_task_width) {
+  memset(r, 0, sizeof(*r));
+  r->fd = fd;
+  r->styled = isatty(fd);
+  r->clip = true;
+  r->id_width = id_width;
+  r->task_width = max_task_width + 2;
+  r->done_width = 6;
+
+  if (r->id_width < 3) { // #
+    r->id_width = 3;
+  }
+  if (r->task_width < 6) { // Task
+    r->task_width = 6;
+  }
+
+  _border(r, TOP_LEFT, TOP_MID, TOP_RIGHT);
+  if (!_reserve(r, RENDER_ROW_EXTRA + r->id_width + r->task_width)) {
+    return false;
+  }
+
+  PUT(r, V_LINE " ");
+  STYLE(r, STYLE_BOLD);
+  PUT(r, "#");
+  STYLE(r, STYLE_RESET);
+  _pad(r, r->id_width - 2);
+  PUT(r, V_LINE " ");
+  STYLE(r, STYLE_BOLD);
+  PUT(r, "Task");
+  STYLE(r, STYLE_RESET);
+  _pad(r, r->task_width - 5);
+  PUT(r, V_LINE " ");
+  STYLE(r, STYLE_BOLD);
+  PUT(r, "Done");
+  STYLE(r, STYLE_RESET);
+  _pad(r, r->done_width - 5);
+  PUT(r, V_LINE "\n");
+
+  _border(r, LEFT_MID, CROSS, RIGHT_MID);
+  return !r->failed;
+}
+
+// Start a table whose widest ID and task text are given, draws the header
+bool render_begin(struct Render *r, int fd, uint32_t max_id,
+                  size_t max_task_width) {
+  return _begin(r, fd, num_digits(max_id) + 2, max_task_width);
+}
+
+// Start a table keyed by strings such as "path:id" instead of plain IDs
+bool render_begin_keyed(struct Render *r, int fd, size_t max_key_width,
+                        size_t max_task_width) {
+  return _begin(r, fd, max_key_width + 2, max_task_width);
+}
+
+// Append rows to a table drawn earlier with the same widths, no header
+bool render_continue(struct Render *r, int fd, uint32_t max_id,
+                     size_t max_task_width) {
+  bool ok = _begin(r, fd, num_digits(max_id) + 2, max_task_width);
+  r->len = 0; // Drop the header _begin drew
+  return ok;
+}
+
+// Start a table whose rows arrive one at a time, the output is written out
+// in chunks instead of at the end. On a terminal the task column is sized
+// up front to fit it and longer tasks are cut. Piped output keeps every
+// byte of the text, tasks wider than a fixed column push its border out.
+bool render_begin_stream(struct Render *r, int fd, uint32_t max_id) {
+  size_t task_width = STREAM_TASK_WIDTH;
+  bool tty = isatty(fd);
+
+  struct winsize ws;
+  if (tty && ioctl(fd, TIOCGWINSZ, &ws) == 0) {
+    // Four borders, the ID column and the six columns of Done
+    int room = ws.ws_col - 4 - (num_digits(max_id) + 2) - 6 - 2;
+    task_width = room > 4 ? room : 4;
+  }
+
+  if (!render_begin(r, fd, max_id, task_width)) {
+    return false;
+  }
+  r->streaming = true;
+  r->clip = tty;
+  return true;
+}
+
+// Write out everything rendered so far
+bool _flush(struct Render *r) {
+  // Anything printed through stdio so far must come first
+  fflush(stdout);
+
+  const char *p = r->data;
+  size_t left = r->failed ? 0 : r->len;
+  while (left > 0) {
+    ssize_t n = write(r->fd, p, left);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n < 0) {
+      r->failed = true;
+      break;
+    }
+    p += n;
+    left -= n;
+  }
+
+  r->len = 0;
+  return !r->failed;
+}
+
+// Move the cursor to the start of a terminal line (from 1) and clear it
+void render_goto(struct Render *r, int line) {
+  if (!r->styled || !_reserve(r, 32)) {
+    return;
+  }
+  r->len += snprintf(r->data + r->len, 32, "\x1b[%d;1H\x1b[2K", line);
+}
+
+// Append the task and done cells that end every row
+void _row_task(struct Render *r, const char *text, size_t len, bool is_done) {
+  // Tasks wider than a fixed column are cut short with an ellipsis
+  size_t fit;
+  size_t room = r->task_width - 2;
+  size_t width = _measure(text, len, room, &fit);
+  PUT(r, V_LINE " ");
+  if (fit < len && !r->clip) {
+    width = room; // Whole text, one space before the pushed out border
+    _put(r, text, len);
+  } else if (fit < len) {
+    width = _measure(text, len, room - 1, &fit) + 1;
+    _put(r, text, fit);
+    PUT(r, ELLIPSIS);
+  } else {
+    _put(r, text, len);
+  }
+  _pad(r, r->task_width - (int)width - 1);
+
+  PUT(r, V_LINE " ");
+  if (is_done) {
+    STYLE(r, COLOR_GREEN);
+    PUT(r, CHECK_MARK);
+  } else {
+    STYLE(r, COLOR_RED);
+    PUT(r, CROSS_MARK);
+  }
+  STYLE(r, STYLE_RESET);
+  _pad(r, r->done_width - 2);
+  PUT(r, V_LINE "\n");
+
+  if (r->streaming && r->len >= RENDER_FLUSH_SIZE) {
+    _flush(r);
+  }
+}
+
+// Append one task row
+void render_row(struct Render *r, uint32_t id, const char *text, size_t len,
+                bool is_done) {
+  if (!_reserve(r, RENDER_ROW_EXTRA + r->id_width + r->task_width + len)) {
+    return;
+  }
+
+  // Digits are written backwards into place, no formatting call per row
+  int digits = num_digits(id);
+  PUT(r, V_LINE " ");
+  char *end = r->data + r->len + digits;
+  for (int i = 0; i < digits; i++) {
+    *--end = '0' + id % 10;
+    id /= 10;
+  }
+  r->len += digits;
+  _pad(r, r->id_width - digits - 1);
+
+  _row_task(r, text, len, is_done);
+}
+
+// Append one task row under a string key
+void render_row_keyed(struct Render *r, const char *key, size_t key_len,
+                      const char *text, size_t len, bool is_done) {
+  if (!_reserve(r, RENDER_ROW_EXTRA + r->id_width + key_len + r->task_width +
+                       len)) {
+    return;
+  }
+
+  PUT(r, V_LINE " ");
+  _put(r, key, key_len);
+  _pad(r, r->id_width - (int)display_width(key, key_len) - 1);
+
+  _row_task(r, text, len, is_done);
+}
+
+// Draw the bottom border, write everything out and release the buffer
+bool render_end(struct Render *r) {
+  _border(r, BOTTOM_LEFT, BOTTOM_MID, BOTTOM_RIGHT);
+
+  if (!_flush(r)) {
+    print_err(strerror(errno));
+  }
+
+  bool ok = !r->failed;
+  free(r->data);
+  memset(r, 0, sizeof(*r));
+  return ok;
+}
@@ -0,0 +1,85 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2025 Võ Quang Chiến
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef RENDER_H
+#define RENDER_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Task table rendered into one buffer and written out in a single call
+struct Render {
+  int fd;
+  bool styled; // Emit ANSI styles, only when fd is a terminal
+  int id_width;
+  int task_width;
+  int done_width;
+  char *data;
+  size_t len;
+  size_t cap;
+  bool streaming; // Rows are written out as they come, not at the end
+  bool clip;      // Cut tasks wider than the column with an ellipsis
+  bool failed;
+};
+
+// Number of decimal digits of n
+int num_digits(uint32_t n);
+
+// Terminal columns taken by len bytes of UTF-8 text
+size_t display_width(const char *text, size_t len);
+
+// Start a table whose widest ID and task text are given, draws the header
+bool render_begin(struct Render *r, int fd, uint32_t max_id,
+                  size_t max_task_width);
+
+// Start a table whose rows arrive one at a time. On a terminal the task
+// column is sized to it up front and longer tasks are cut, elsewhere they
+// are written whole past a fixed column.
+bool render_begin_stream(struct Render *r, int fd, uint32_t max_id);
+
+// Start a table keyed by strings such as "path:id" instead of plain IDs
+bool render_begin_keyed(struct Render *r, int fd, size_t max_key_width,
+                        size_t max_task_width);
+
+// Append rows to a table drawn earlier with the same widths, no header
+bool render_continue(struct Render *r, int fd, uint32_t max_id,
+                     size_t max_task_width);
+
+// Move the cursor to the start of a terminal line (from 1) and clear it,
+// only on a terminal
+void render_goto(struct Render *r, int line);
+
+// Append one task row
+void render_row(struct Render *r, uint32_t id, const char *text, size_t len,
+                bool is_done);
+
+// Append one task row under a string key
+void render_row_keyed(struct Render *r, const char *key, size_t key_len,
+                      const char *text, size_t len, bool is_done);
+
+// Draw the bottom border, write everything out and release the buffer
+bool render_end(struct Render *r);
+
+#endif
@@ -0,0 +1,149 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2025 Võ Quang Chiến
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "scan.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __x86_64__
+#include <immintrin.h>
+#define SCAN_X86 1
+#endif
+
+// Byte at a time, used for tails and on CPUs without a vector path
+size_t _newlines_scalar(const char *data, size_t from, size_t size,
+                        size_t *out, size_t max) {
+  size_t n = 0;
+  for (size_t i = from; i < size && n < max; i++) {
+    if (data[i] == '\n') {
+      out[n++] = i;
+    }
+  }
+  return n;
+}
+
+#ifdef SCAN_X86
+// Turn a block match mask into offsets, return false once out is full
+static inline bool _emit(unsigned mask, size_t base, size_t *out, size_t *n,
+                         size_t max) {
+  while (mask) {
+    if (*n == max) {
+      return false;
+    }
+    out[(*n)++] = base + __builtin_ctz(mask);
+    mask &= mask - 1;
+  }
+  return true;
+}
+
+// 16 bytes per step, SSE2 is part of every x86-64 CPU
+size_t _newlines_sse2(const char *data, size_t from, size_t size, size_t *out,
+                      size_t max) {
+  const __m128i nl = _mm_set1_epi8('\n');
+  size_t n = 0;
+  size_t i = from;
+
+  for (; i + 16 <= size; i += 16) {
+    __m128i block = _mm_loadu_si128((const __m128i *)(data + i));
+    unsigned mask = _mm_movemask_epi8(_mm_cmpeq_epi8(block, nl));
+    if (!_emit(mask, i, out, &n, max)) {
+      return n;
+    }
+  }
+  return n + _newlines_scalar(data, i, size, out + n, max - n);
+}
+
+// 32 bytes per step
+__attribute__((target("avx2"))) size_t
+_newlines_avx2(const char *data, size_t from, size_t size, size_t *out,
+               size_t max) {
+  const __m256i nl = _mm256_set1_epi8('\n');
+  size_t n = 0;
+  size_t i = from;
+
+  for (; i + 32 <= size; i += 32) {
+    __m256i block = _mm256_loadu_si256((const __m256i *)(data + i));
+    unsigned mask = _mm256_movemask_epi8(_mm256_cmpeq_epi8(block, nl));
+    if (!_emit(mask, i, out, &n, max)) {
+      return n;
+    }
+  }
+  return n + _newlines_sse2(data, i, size, out + n, max - n);
+}
+#endif
+
+static newline_fn _impl;
+static const char *_impl_name;
+static pthread_once_t _impl_once = PTHREAD_ONCE_INIT;
+
+// Scanner called name if it is built in and this CPU runs it, NULL if not
+newline_fn scan_impl(const char *name) {
+  if (strcmp(name, "scalar") == 0) {
+    return _newlines_scalar;
+  }
+#ifdef SCAN_X86
+  if (strcmp(name, "sse2") == 0) {
+    return _newlines_sse2;
+  }
+  __builtin_cpu_init();
+  if (strcmp(name, "avx2") == 0 && __builtin_cpu_supports("avx2")) {
+    return _newlines_avx2;
+  }
+#endif
+  return NULL;
+}
+
+// Pick the widest scanner the CPU supports, TD_SCAN forces one by name so
+// the paths can be compared against each other on the same input. Runs
+// once, before the first scan of any thread.
+void _scan_init(void) {
+  static const char *names[] = {"avx2", "sse2", "scalar"};
+  const char *forced = getenv("TD_SCAN");
+
+  if (forced && (_impl = scan_impl(forced))) {
+    _impl_name = forced;
+    return;
+  }
+  for (size_t i = 0; !_impl; i++) {
+    _impl_name = names[i];
+    _impl = scan_impl(names[i]);
+  }
+}
+
+// Store the offsets of up to max newlines in data[from, size) into out and
+// return how many were found. Fewer than max means the range is exhausted.
+size_t find_newlines(const char *data, size_t from, size_t size, size_t *out,
+                     size_t max) {
+  pthread_once(&_impl_once, _scan_init);
+  return _impl(data, from, size, out, max);
+}
+
+// Name of the scanner picked for this CPU (scalar, sse2 or avx2)
+const char *scan_impl_name(void) {
+  pthread_once(&_impl_once, _scan_init);
+  return _impl_name;
+}
@@ -0,0 +1,48 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2025 Võ Quang Chiến
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef SCAN_H
+#define SCAN_H
+
+#include <stddef.h>
+
+// Number of newline offsets find_newlines hands back per call in scan loops
+#define SCAN_BATCH 256
+
+// A newline scanner, see find_newlines
+typedef size_t (*newline_fn)(const char *data, size_t from, size_t size,
+                             size_t *out, size_t max);
+
+// Store the offsets of up to max newlines in data[from, size) into out and
+// return how many were found. Fewer than max means the range is exhausted.
+size_t find_newlines(const char *data, size_t from, size_t size, size_t *out,
+                     size_t max);
+
+// Name of the scanner picked for this CPU (scalar, sse2 or avx2)
+const char *scan_impl_name(void);
+
+// Scanner called name if it is built in and this CPU runs it, NULL if not
+newline_fn scan_impl(const char *name);
+
+#endif
@@ -0,0 +1,421 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2025 Võ Quang Chiến
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "serialize.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "fmt.h"
+#include "stats.h"
+
+// Constants
+#define SERIALIZE_BUFFER_SIZE (256 * 1024)
+#define SERIALIZE_TICKS 256 // Ticks between clock reads of a prompt stream
+#define SERIALIZE_DELAY_NS (10 * 1000000ull) // Longest a prompt record waits
+#define REPLACEMENT "\\ufffd" // Stands in for bytes that are not UTF-8
+
+// Parse a format name (table, json, ndjson, tsv)
+bool parse_format(const char *name, enum Format *out) {
+  if (strcmp(name, "table") == 0) {
+    *out = FORMAT_TABLE;
+  } else if (strcmp(name, "json") == 0) {
+    *out = FORMAT_JSON;
+  } else if (strcmp(name, "ndjson") == 0) {
+    *out = FORMAT_NDJSON;
+  } else if (strcmp(name, "tsv") == 0) {
+    *out = FORMAT_TSV;
+  } else {
+    return false;
+  }
+  return true;
+}
+
+// Write out the buffer
+bool _serializer_flush(struct Serializer *s) {
+  const char *p = s->data;
+  size_t left = s->failed ? 0 : s->len;
+  while (left > 0) {
+    ssize_t n = write(s->fd, p, left);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n < 0) {
+      print_err(strerror(errno));
+      s->failed = true;
+      break;
+    }
+    p += n;
+    left -= n;
+  }
+
+  s->len = 0;
+  if (s->prompt) {
+    s->flushed_ns = _clock_ns(CLOCK_MONOTONIC);
+  }
+  return !s->failed;
+}
+
+// Append bytes, flushing whenever the buffer fills up
+void _emit(struct Serializer *s, const char *data, size_t n) {
+  while (n > 0 && !s->failed) {
+    size_t room = SERIALIZE_BUFFER_SIZE - s->len;
+    if (room == 0) {
+      _serializer_flush(s);
+      continue;
+    }
+
+    size_t chunk = n < room ? n : room;
+    memcpy(s->data + s->len, data, chunk);
+    s->len += chunk;
+    data += chunk;
+    n -= chunk;
+  }
+}
+
+#define EMIT(s, literal) _emit(s, literal, sizeof(literal) - 1)
+
+// Append an unsigned number
+void _emit_u64(struct Serializer *s, uint64_t n) {
+  char digits[20];
+  size_t i = sizeof(digits);
+  do {
+    digits[--i] = '0' + n % 10;
+    n /= 10;
+  } while (n > 0);
+  _emit(s, digits + i, sizeof(digits) - i);
+}
+
+// Length of the well-formed UTF-8 sequence at p with left bytes to go, 0
+// for a stray byte, an overlong form, a surrogate or a truncated sequence
+size_t _utf8_length(const unsigned char *p, size_t left) {
+  unsigned char lo = 0x80, hi = 0xbf; // Range of the second byte
+  size_t n;
+  if (p[0] >= 0xc2 && p[0] <= 0xdf) {
+    n = 2;
+  } else if (p[0] >= 0xe0 && p[0] <= 0xef) {
+    n = 3;
+    lo = p[0] == 0xe0 ? 0xa0 : lo;
+    hi = p[0] == 0xed ? 0x9f : hi;
+  } else if (p[0] >= 0xf0 && p[0] <= 0xf4) {
+    n = 4;
+    lo = p[0] == 0xf0 ? 0x90 : lo;
+    hi = p[0] == 0xf4 ? 0x8f : hi;
+  } else {
+    return 0;
+  }
+
+  if (left < n || p[1] < lo || p[1] > hi) {
+    return 0;
+  }
+  for (size_t i = 2; i < n; i++) {
+    if ((p[i] & 0xc0) != 0x80) {
+      return 0;
+    }
+  }
+  return n;
+}
+
+// Append text as the inside of a JSON string, copying unescaped runs whole.
+// Bytes that are not UTF-8 become U+FFFD, one per byte.
+void _emit_json(struct Serializer *s, const char *text, size_t len) {
+  static const char hex[] = "0123456789abcdef";
+  const unsigned char *p = (const unsigned char *)text;
+  size_t run = 0;
+
+  for (size_t i = 0; i < len; i++) {
+    unsigned char c = p[i];
+    if (c >= 0x20 && c < 0x80 && c != '"' && c != '\\') {
+      continue;
+    }
+    if (c >= 0x80) {
+      size_t n = _utf8_length(p + i, len - i);
+      if (n > 0) {
+        i += n - 1;
+        continue;
+      }
+      _emit(s, text + run, i - run);
+      run = i + 1;
+      EMIT(s, REPLACEMENT);
+      continue;
+    }
+
+    _emit(s, text + run, i - run);
+    run = i + 1;
+
+    switch (c) {
+    case '"':
+      EMIT(s, "\\\"");
+      break;
+    case '\\':
+      EMIT(s, "\\\\");
+      break;
+    case '\t':
+      EMIT(s, "\\t");
+      break;
+    case '\r':
+      EMIT(s, "\\r");
+      break;
+    default: {
+      char escape[] = {'\\', 'u', '0', '0', hex[c >> 4], hex[c & 15]};
+      _emit(s, escape, sizeof(escape));
+    }
+    }
+  }
+  _emit(s, text + run, len - run);
+}
+
+// Append text as one TSV field, tabs and backslashes are escaped
+void _emit_tsv(struct Serializer *s, const char *text, size_t len) {
+  size_t run = 0;
+
+  for (size_t i = 0; i < len; i++) {
+    char c = text[i];
+    if (c != '\t' && c != '\\' && c != '\r' && c != '\n') {
+      continue;
+    }
+
+    _emit(s, text + run, i - run);
+    run = i + 1;
+
+    switch (c) {
+    case '\t':
+      EMIT(s, "\\t");
+      break;
+    case '\\':
+      EMIT(s, "\\\\");
+      break;
+    case '\r':
+      EMIT(s, "\\r");
+      break;
+    default:
+      EMIT(s, "\\n");
+    }
+  }
+  _emit(s, text + run, len - run);
+}
+
+// Append a "key":"value" pair (or a TSV field) for a C string
+void _emit_string(struct Serializer *s, const char *key, const char *value) {
+  if (s->format == FORMAT_TSV) {
+    _emit_tsv(s, value, strlen(value));
+    return;
+  }
+
+  EMIT(s, "\"");
+  _emit(s, key, strlen(key));
+  EMIT(s, "\":\"");
+  _emit_json(s, value, strlen(value));
+  EMIT(s, "\"");
+}
+
+// Start a record, separating it from the previous one
+void _begin_record(struct Serializer *s) {
+  if (s->format == FORMAT_JSON && s->rows > 0) {
+    EMIT(s, ",");
+  }
+  if (s->format != FORMAT_TSV) {
+    EMIT(s, "{");
+  }
+  s->rows++;
+}
+
+// Finish a record
+void _end_record(struct Serializer *s) {
+  if (s->format != FORMAT_TSV) {
+    EMIT(s, "}");
+  }
+  if (s->format != FORMAT_JSON) {
+    EMIT(s, "\n");
+  }
+  serializer_tick(s);
+}
+
+// Note that a scan passed a task without adding it. Records waiting in the
+// buffer of a prompt stream are written out once they are old enough.
+void serializer_tick(struct Serializer *s) {
+  // The clock is read every few ticks, a record waits a little longer than
+  // the delay at most
+  if (!s->prompt || s->len == 0 || ++s->ticks < SERIALIZE_TICKS) {
+    return;
+  }
+  s->ticks = 0;
+  if (_clock_ns(CLOCK_MONOTONIC) - s->flushed_ns >= SERIALIZE_DELAY_NS) {
+    _serializer_flush(s);
+  }
+}
+
+// Start a list of tasks
+bool serializer_begin(struct Serializer *s, int fd, enum Format format) {
+  memset(s, 0, sizeof(*s));
+  s->fd = fd;
+  s->format = format;
+  s->data = malloc(SERIALIZE_BUFFER_SIZE);
+  if (!s->data) {
+    print_err("Memory allocation failed");
+    s->failed = true;
+    return false;
+  }
+
+  // Anything printed through stdio so far must come first
+  fflush(stdout);
+
+  // A reader at the other end of a pipe or terminal acts on NDJSON records
+  // as they come, files get full buffers
+  struct stat st;
+  s->prompt = format == FORMAT_NDJSON &&
+              (isatty(fd) || (fstat(fd, &st) == 0 && (S_ISFIFO(st.st_mode) ||
+                                                      S_ISSOCK(st.st_mode))));
+  if (s->prompt) {
+    s->flushed_ns = _clock_ns(CLOCK_MONOTONIC);
+  }
+
+  if (format == FORMAT_JSON) {
+    EMIT(s, "[");
+  }
+  return true;
+}
+
+// Append one task, its text is escaped straight into the buffer
+void serialize_task(struct Serializer *s, uint32_t id, const char *text,
+                    size_t len, bool is_done) {
+  serialize_task_in(s, NULL, id, text, len, is_done);
+}
+
+// Append one task of file_path, NULL leaving the file field out
+void serialize_task_in(struct Serializer *s, const char *file_path,
+                       uint32_t id, const char *text, size_t len,
+                       bool is_done) {
+  if (s->format == FORMAT_TSV && s->rows == 0) {
+    if (file_path) {
+      EMIT(s, "file\t");
+    }
+    EMIT(s, "id\tdone\ttask\n");
+  }
+  _begin_record(s);
+
+  if (file_path) {
+    _emit_string(s, "file", file_path);
+    _emit(s, s->format == FORMAT_TSV ? "\t" : ",", 1);
+  }
+
+  if (s->format == FORMAT_TSV) {
+    _emit_u64(s, id);
+    _emit(s, is_done ? "\t1\t" : "\t0\t", 3);
+    _emit_tsv(s, text, len);
+  } else {
+    EMIT(s, "\"id\":");
+    _emit_u64(s, id);
+    if (is_done) {
+      EMIT(s, ",\"done\":true,\"task\":\"");
+    } else {
+      EMIT(s, ",\"done\":false,\"task\":\"");
+    }
+    _emit_json(s, text, len);
+    EMIT(s, "\"");
+  }
+
+  _end_record(s);
+}
+
+// Append the task counts of file_path, or of its section of len bytes when
+// section is set
+void serialize_counts(struct Serializer *s, const char *file_path,
+                      const char *section, size_t len, size_t total,
+                      size_t done) {
+  if (s->format == FORMAT_TSV && s->rows == 0) {
+    EMIT(s, "file\tsection\ttotal\topen\tdone\tpercent\n");
+  }
+  _begin_record(s);
+
+  const char *sep = s->format == FORMAT_TSV ? "\t" : ",";
+  _emit_string(s, "file", file_path);
+  if (s->format == FORMAT_TSV) {
+    EMIT(s, "\t");
+    _emit_tsv(s, section ? section : "", section ? len : 0);
+  } else if (section) {
+    EMIT(s, ",\"section\":\"");
+    _emit_json(s, section, len);
+    EMIT(s, "\"");
+  }
+
+  size_t values[] = {total, total - done, done};
+  const char *keys[] = {"\"total\":", "\"open\":", "\"done\":"};
+  for (size_t i = 0; i < 3; i++) {
+    _emit(s, sep, 1);
+    if (s->format != FORMAT_TSV) {
+      _emit(s, keys[i], strlen(keys[i]));
+    }
+    _emit_u64(s, values[i]);
+  }
+
+  char percent[32];
+  int n = snprintf(percent, sizeof(percent), "%s%.1f",
+                   s->format == FORMAT_TSV ? "\t" : ",\"percent\":",
+                   total ? 100.0 * done / total : 0.0);
+  _emit(s, percent, n);
+
+  _end_record(s);
+}
+
+// Append the outcome of a command run on file_path with argument value
+void serialize_result(struct Serializer *s, const char *command,
+                      const char *value, const char *file_path, bool ok) {
+  if (s->format == FORMAT_TSV && s->rows == 0) {
+    EMIT(s, "command\targument\tfile\tok\n");
+  }
+  _begin_record(s);
+
+  _emit_string(s, "command", command);
+  _emit(s, s->format == FORMAT_TSV ? "\t" : ",", 1);
+  _emit_string(s, "argument", value ? value : "");
+  _emit(s, s->format == FORMAT_TSV ? "\t" : ",", 1);
+  _emit_string(s, "file", file_path);
+  if (s->format == FORMAT_TSV) {
+    _emit(s, ok ? "\t1" : "\t0", 2);
+  } else if (ok) {
+    EMIT(s, ",\"ok\":true");
+  } else {
+    EMIT(s, ",\"ok\":false");
+  }
+
+  _end_record(s);
+}
+
+// Close the list, write everything out and release the buffer
+bool serializer_end(struct Serializer *s) {
+  if (s->format == FORMAT_JSON) {
+    EMIT(s, "]\n");
+  }
+
+  _serializer_flush(s);
+  bool ok = !s->failed;
+  free(s->data);
+  memset(s, 0, sizeof(*s));
+  return ok;
+}
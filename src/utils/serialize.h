@@ -0,0 +1,86 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2025 Võ Quang Chiến
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef SERIALIZE_H
+#define SERIALIZE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// How results are printed
+enum Format {
+  FORMAT_TABLE,  // Box-drawing table and messages for humans
+  FORMAT_JSON,   // One JSON array of task objects
+  FORMAT_NDJSON, // One JSON object per line
+  FORMAT_TSV,    // Tab separated values with a header line
+};
+
+// Streaming writer of tasks and command results in a machine format, all
+// output goes through one fixed buffer
+struct Serializer {
+  int fd;
+  enum Format format;
+  char *data;
+  size_t len;
+  size_t rows;
+  bool prompt;         // A reader waits on each record, NDJSON to a pipe
+  unsigned ticks;      // Records and skipped tasks since the last clock read
+  uint64_t flushed_ns; // When the buffer was last written out
+  bool failed;
+};
+
+// Parse a format name (table, json, ndjson, tsv)
+bool parse_format(const char *name, enum Format *out);
+
+// Start a list of tasks
+bool serializer_begin(struct Serializer *s, int fd, enum Format format);
+
+// Append one task, its text is escaped straight into the buffer
+void serialize_task(struct Serializer *s, uint32_t id, const char *text,
+                    size_t len, bool is_done);
+
+// Append one task of file_path, NULL leaving the file field out
+void serialize_task_in(struct Serializer *s, const char *file_path,
+                       uint32_t id, const char *text, size_t len,
+                       bool is_done);
+
+// Append the task counts of file_path, or of its section of len bytes when
+// section is set
+void serialize_counts(struct Serializer *s, const char *file_path,
+                      const char *section, size_t len, size_t total,
+                      size_t done);
+
+// Note that a scan passed a task without adding it. Records waiting in the
+// buffer of a prompt stream are written out once they are old enough.
+void serializer_tick(struct Serializer *s);
+
+// Append the outcome of a command run on file_path with argument value
+void serialize_result(struct Serializer *s, const char *command,
+                      const char *value, const char *file_path, bool ok);
+
+// Close the list, write everything out and release the buffer
+bool serializer_end(struct Serializer *s);
+
+#endif
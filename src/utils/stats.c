@@ -0,0 +1,207 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2025 Võ Quang Chiến
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#include "stats.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+// Constants
+#define STATS_MAX_SPANS 1024
+
+// One timed phase
+struct _Span {
+  const char *name;
+  uint64_t wall_start; // Nanoseconds on the monotonic clock
+  uint64_t wall_end;
+  uint64_t cpu_start; // Process CPU time, parser threads included
+  uint64_t cpu_end;
+  int depth;
+};
+
+bool stats_on;
+uint64_t stats_counters[STAT_COUNTERS];
+
+static const char *counter_names[STAT_COUNTERS] = {
+    "bytes_read", "bytes_written", "opens",       "renames",
+    "fsyncs",     "arena_blocks",  "arena_bytes",
+};
+
+static struct _Span spans[STATS_MAX_SPANS];
+static size_t span_count;
+static int depth;
+static bool print_summary;
+static const char *trace;
+
+// Current time of clock in nanoseconds
+uint64_t _clock_ns(clockid_t clock) {
+  struct timespec ts;
+  clock_gettime(clock, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// Turn instrumentation on if a summary is wanted or trace_path is set
+void stats_init(bool print, const char *trace_path) {
+  print_summary = print;
+  trace = trace_path && *trace_path ? trace_path : NULL;
+  stats_on = print_summary || trace;
+}
+
+// Start timing a phase, name must outlive the invocation. Phases nest on
+// the main thread only, worker threads just bump counters.
+size_t stats_begin(const char *name) {
+  if (!stats_on || span_count == STATS_MAX_SPANS || gettid() != getpid()) {
+    return STATS_OFF;
+  }
+
+  struct _Span *span = &spans[span_count];
+  span->name = name;
+  span->depth = depth++;
+  span->cpu_start = _clock_ns(CLOCK_PROCESS_CPUTIME_ID);
+  span->wall_start = _clock_ns(CLOCK_MONOTONIC);
+  return span_count++;
+}
+
+// Stop timing the phase started by stats_begin
+void stats_end(size_t span) {
+  if (span == STATS_OFF) {
+    return;
+  }
+  spans[span].wall_end = _clock_ns(CLOCK_MONOTONIC);
+  spans[span].cpu_end = _clock_ns(CLOCK_PROCESS_CPUTIME_ID);
+  depth--;
+}
+
+// Peak resident set size in KiB
+long _peak_rss(void) {
+  struct rusage usage;
+  return getrusage(RUSAGE_SELF, &usage) == 0 ? usage.ru_maxrss : 0;
+}
+
+// Print the phases and counters to stderr
+void _print_summary(void) {
+  fprintf(stderr, "%-32s %12s %12s\n", "Phase", "Wall ms", "CPU ms");
+  for (size_t i = 0; i < span_count; i++) {
+    const struct _Span *s = &spans[i];
+    fprintf(stderr, "%*s%-*s %12.3f %12.3f\n", s->depth * 2, "",
+            32 - s->depth * 2, s->name, (s->wall_end - s->wall_start) / 1e6,
+            (s->cpu_end - s->cpu_start) / 1e6);
+  }
+
+  fputc('\n', stderr);
+  for (int i = 0; i < STAT_COUNTERS; i++) {
+    fprintf(stderr, "%-32s %12llu\n", counter_names[i],
+            (unsigned long long)stats_counters[i]);
+  }
+  fprintf(stderr, "%-32s %12ld\n", "peak_rss_kb", _peak_rss());
+}
+
+// Write s as the inside of a JSON string
+void _json_string(FILE *out, const char *s) {
+  for (; *s; s++) {
+    unsigned char c = *s;
+    if (c == '"' || c == '\\') {
+      fprintf(out, "\\%c", c);
+    } else if (c < 0x20) {
+      fprintf(out, "\\u%04x", c);
+    } else {
+      fputc(c, out);
+    }
+  }
+}
+
+// Append the invocation as Chrome trace events. The file is a JSON array
+// left open at the end, which trace viewers accept, so runs can pile up.
+void _append_trace(int argc, char **argv) {
+  int fd = open(trace, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+  FILE *out = fd >= 0 ? fdopen(fd, "a") : NULL;
+  if (!out) {
+    fprintf(stderr, "TD_TRACE: %s: %s\n", trace, strerror(errno));
+    if (fd >= 0) {
+      close(fd);
+    }
+    return;
+  }
+
+  struct stat st;
+  if (fstat(fd, &st) == 0 && st.st_size == 0) {
+    fputs("[\n", out);
+  }
+
+  int pid = getpid();
+  fprintf(out, "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,"
+               "\"tid\":%d,\"args\":{\"name\":\"", pid, pid);
+  for (int i = 0; i < argc; i++) {
+    if (i > 0) {
+      fputc(' ', out);
+    }
+    _json_string(out, argv[i]);
+  }
+  fputs("\"}},\n", out);
+
+  for (size_t i = 0; i < span_count; i++) {
+    const struct _Span *s = &spans[i];
+    fputs("{\"name\":\"", out);
+    _json_string(out, s->name);
+    fprintf(out,
+            "\",\"cat\":\"td\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,"
+            "\"pid\":%d,\"tid\":%d,\"args\":{\"cpu_us\":%.3f}},\n",
+            s->wall_start / 1e3, (s->wall_end - s->wall_start) / 1e3, pid,
+            pid, (s->cpu_end - s->cpu_start) / 1e3);
+  }
+
+  uint64_t end = span_count ? spans[0].wall_end : _clock_ns(CLOCK_MONOTONIC);
+  for (size_t i = 1; i < span_count; i++) {
+    end = spans[i].wall_end > end ? spans[i].wall_end : end;
+  }
+  fprintf(out, "{\"name\":\"td\",\"ph\":\"C\",\"ts\":%.3f,\"pid\":%d,"
+               "\"args\":{", end / 1e3, pid);
+  for (int i = 0; i < STAT_COUNTERS; i++) {
+    fprintf(out, "\"%s\":%llu,", counter_names[i],
+            (unsigned long long)stats_counters[i]);
+  }
+  fprintf(out, "\"peak_rss_kb\":%ld}},\n", _peak_rss());
+
+  fclose(out);
+}
+
+// Print the summary and append the trace of this invocation
+void stats_finish(int argc, char **argv) {
+  if (!stats_on) {
+    return;
+  }
+  if (print_summary) {
+    fflush(stdout); // Keep the summary after the command's own output
+    _print_summary();
+  }
+  if (trace) {
+    _append_trace(argc, argv);
+  }
+}
@@ -0,0 +1,74 @@
+/*
+ * MIT License
+ *
+ * Copyright (c) 2025 Võ Quang Chiến
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to deal
+ * in the Software without restriction, including without limitation the rights
+ * to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+ * copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+ * OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+ * SOFTWARE.
+ */
+
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+// Value of stats_begin when instrumentation is off
+#define STATS_OFF SIZE_MAX
+
+// Counters kept for one invocation
+enum StatCounter {
+  STAT_BYTES_READ,
+  STAT_BYTES_WRITTEN,
+  STAT_OPENS,
+  STAT_RENAMES,
+  STAT_FSYNCS,
+  STAT_ARENA_BLOCKS, // Blocks arenas took from malloc, other allocations
+                     // are not counted
+  STAT_ARENA_BYTES,
+  STAT_COUNTERS,
+};
+
+extern bool stats_on;
+extern uint64_t stats_counters[STAT_COUNTERS];
+
+// Bump a counter, a single predictable branch when instrumentation is off
+static inline void stats_add(enum StatCounter counter, uint64_t n) {
+  if (__builtin_expect(stats_on, 0)) {
+    __atomic_fetch_add(&stats_counters[counter], n, __ATOMIC_RELAXED);
+  }
+}
+
+// Current time of clock in nanoseconds
+uint64_t _clock_ns(clockid_t clock);
+
+// Turn instrumentation on if a summary is wanted or trace_path is set
+void stats_init(bool print, const char *trace_path);
+
+// Start timing a phase, name must outlive the invocation
+size_t stats_begin(const char *name);
+
+// Stop timing the phase started by stats_begin
+void stats_end(size_t span);
+
+// Print the summary and append the trace of this invocation
+void stats_finish(int argc, char **argv);
+
+#endif